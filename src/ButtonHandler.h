@@ -2,57 +2,172 @@
 #define BUTTON_HANDLER_H
 
 #include <Arduino.h>
+#include "Debounce.h"
 
 /**
- * @brief Класс для обработки нажатий кнопок с устранением дребезга и определением длительности нажатия.
+ * @brief Параметры кнопки, задаваемые при выполнении: пин и пороги хранятся в экземпляре.
  */
-class ButtonHandler
+class ButtonConfig
 {
 public:
     /**
-     * @brief Конструктор класса ButtonHandler.
+     * @brief Конструктор класса ButtonConfig.
      * @param pin Пин, к которому подключена кнопка.
      * @param debounceDelay Задержка для устранения дребезга в микросекундах.
      * @param longPressThreshold Порог длительного нажатия в микросекундах.
+     * @param tapWindow Окно ожидания следующего касания серии в микросекундах (0 – распознавание серий отключено).
      */
-    ButtonHandler(uint8_t pin, uint32_t debounceDelay, uint32_t longPressThreshold)
-        : pin(pin), debounceDelay(debounceDelay), longPressThreshold(longPressThreshold) {}
+    ButtonConfig(uint8_t pin, uint32_t debounceDelay, uint32_t longPressThreshold, uint32_t tapWindow = 0)
+        : pin(pin), debounceDelay(debounceDelay), longPressThreshold(longPressThreshold), tapWindow(tapWindow) {}
+
+    static const uint8_t NO_PIN = 0xFF; ///< Пин кнопки, уровень которой передаётся в updateState() извне.
+
+    bool readPin() const { return pinMode(pin, INPUT_PULLUP), digitalRead(pin) ? true : false; } ///< @brief Считывает уровень пина кнопки. @return true, если кнопка отпущена.
+
+protected:
+    const uint8_t pin;                 ///< Пин, к которому подключена кнопка.
+    const uint32_t debounceDelay;      ///< Задержка для устранения дребезга в микросекундах.
+    const uint32_t longPressThreshold; ///< Порог длительного нажатия в микросекундах.
+    const uint32_t tapWindow;          ///< Окно ожидания следующего касания серии в микросекундах.
+};
+
+/**
+ * @brief Параметры кнопки, известные при компиляции: пин задаётся портом и номером бита, пороги – константами.
+ * Экземпляр не занимает памяти, а чтение пина сводится к одному чтению регистра IDR.
+ * @tparam PortBase Базовый адрес порта GPIO (например, GPIOA_BASE).
+ * @tparam Bit Номер пина в порту.
+ * @tparam DebounceUs Задержка для устранения дребезга в микросекундах.
+ * @tparam LongPressUs Порог длительного нажатия в микросекундах.
+ * @tparam TapWindowUs Окно ожидания следующего касания серии в микросекундах (0 – распознавание серий отключено).
+ */
+template <uint32_t PortBase, uint8_t Bit, uint32_t DebounceUs, uint32_t LongPressUs, uint32_t TapWindowUs = 0>
+class StaticButtonConfig
+{
+public:
+    static constexpr uint32_t PIN_MASK = 1UL << Bit; ///< Маска пина кнопки в регистрах порта.
+
+    /**
+     * @brief Настраивает пин кнопки как вход с подтяжкой к питанию (однократно, в отличие от ButtonConfig).
+     */
+    static void begin()
+    {
+        GPIO_TypeDef *port = (GPIO_TypeDef *)PortBase;
+        volatile uint32_t &cr = Bit < 8 ? port->CRL : port->CRH;
+        cr = (cr & ~(0xFUL << (Bit % 8 * 4))) | (0x8UL << (Bit % 8 * 4)); // CNF = 10 (вход с подтяжкой), MODE = 00
+        port->BSRR = PIN_MASK;                                             // Подтяжка к питанию
+    }
+
+    static bool readPin() { return ((GPIO_TypeDef *)PortBase)->IDR & PIN_MASK; } ///< @brief Считывает уровень пина кнопки. @return true, если кнопка отпущена.
+
+protected:
+    static constexpr uint32_t debounceDelay = DebounceUs;       ///< Задержка для устранения дребезга в микросекундах.
+    static constexpr uint32_t longPressThreshold = LongPressUs; ///< Порог длительного нажатия в микросекундах.
+    static constexpr uint32_t tapWindow = TapWindowUs;          ///< Окно ожидания следующего касания серии в микросекундах.
+};
+
+/**
+ * @brief Класс для обработки нажатий кнопок с устранением дребезга и определением длительности нажатия.
+ *
+ * Дополнительно класс распознаёт серии коротких нажатий (одиночное, двойное и тройное касание):
+ * серия продолжается, пока следующее нажатие начинается не позже окна ожидания после отпускания.
+ * Пин и пороги берутся из параметров Config: ButtonConfig (ButtonHandler) задаёт их при выполнении,
+ * StaticButtonConfig (StaticButtonHandler) – при компиляции. Алгоритм устранения дребезга задаётся
+ * стратегией Debounce (см. Debounce.h).
+ */
+template <class Config, class Debounce = TimestampDebounce>
+class BasicButtonHandler : public Config
+{
+public:
+    using Config::Config;
+
+    static const uint8_t MAX_TAPS = 3; ///< Максимальная длина серии касаний; по её достижении серия завершается сразу.
 
     /**
      * @brief Обновляет состояние кнопки.
-     * Функция считывает текущее состояние кнопки, устраняет дребезг и определяет,
-     * является ли нажатие кратковременным или длительным.
+     * Функция считывает текущее состояние кнопки, устраняет дребезг стратегией Debounce, запоминает моменты нажатия
+     * и отпускания и по длительности нажатия определяет, было ли оно кратковременным или длительным.
+     * Серия касаний завершается по истечении окна ожидания, длительному нажатию или достижении MAX_TAPS.
      * @param ticks Текущее время в микросекундах.
      */
-    void updateState(uint64_t ticks)
+    void updateState(uint64_t ticks) { updateState(Config::readPin(), ticks); }
+
+    /**
+     * @brief Обновляет состояние кнопки по уровню сигнала, полученному извне (например, из сканера матрицы).
+     * @param pin_value Уровень сигнала кнопки (true – отпущена, false – нажата).
+     * @param ticks Текущее время в микросекундах.
+     */
+    void updateState(bool pin_value, uint64_t ticks)
     {
-        pinMode(pin, INPUT_PULLUP);
-        bool pin_value = digitalRead(pin) ? true : false;
-        if (pin_value != last_pin_value)
-            lastDebounceTime = ticks + debounceDelay;
-        if (ticks >= lastDebounceTime && pressed_f != (pin_value == LOW))
-            if (pressed_f = (pin_value == LOW))
-                lastDebounceTime = ticks + longPressThreshold;
-            else if (ticks >= lastDebounceTime)
-                longPress_f = true;
+        bool level = debounce.update(pin_value, ticks, this->debounceDelay);
+        if (pressed_f != (level == LOW))
+            if (pressed_f = (level == LOW))
+            {
+                pressStartTime = debounce.edgeTime();
+                if (tapCount && pressStartTime - releaseTime > this->tapWindow)
+                    finishTaps(); // Нажатие началось после окна ожидания – предыдущая серия завершена
+            }
             else
-                shortPress_f = true;
-        last_pin_value = pin_value;
+            {
+                releaseTime = debounce.edgeTime();
+                pressDuration = releaseTime - pressStartTime;
+                if (suppressed_f)
+                    suppressed_f = false; // Нажатие уже учтено внешним распознавателем (например, аккордом)
+                else if (pressDuration >= this->longPressThreshold)
+                    longPress_f = true, finishTaps();
+                else
+                {
+                    shortPress_f = true;
+                    if (this->tapWindow && ++tapCount >= MAX_TAPS)
+                        finishTaps(); // Серия максимальной длины завершается без ожидания
+                }
+            }
+        if (tapCount && !pressed_f && pin_value && ticks - releaseTime > this->tapWindow)
+            finishTaps(); // Окно ожидания истекло без нового нажатия
     }
 
     bool isPressedNow() const { return pressed_f; }                                ///< @brief Проверяет, нажата ли кнопка. @return true, если кнопка нажата, иначе false.
     bool isShortPress() { return shortPress_f ? !(shortPress_f = false) : false; } ///< @brief Проверяет, было ли кратковременное нажатие кнопки. @return true, если было кратковременное нажатие, иначе false.
     bool isLongPress() { return longPress_f ? !(longPress_f = false) : false; }    ///< @brief Проверяет, было ли длительное нажатие кнопки. @return true, если было длительное нажатие, иначе false.
+    uint32_t pressStartMs() const { return pressStartTime / 1000; }                ///< @brief Момент начала последнего нажатия. @return Время в миллисекундах с момента запуска.
+    uint32_t releaseMs() const { return releaseTime / 1000; }                      ///< @brief Момент последнего отпускания. @return Время в миллисекундах с момента запуска.
+    uint32_t pressDurationMs() const { return pressDuration / 1000; }              ///< @brief Длительность последнего завершённого нажатия. @return Длительность в миллисекундах.
+    uint64_t pressStartTicks() const { return pressStartTime; }                    ///< @brief Момент начала последнего нажатия. @return Время в микросекундах с момента запуска.
+    uint8_t takeTapCount() { uint8_t taps = tapEvent; return tapEvent = 0, taps; } ///< @brief Возвращает и сбрасывает длину последней завершённой серии касаний. @return Количество касаний (1..MAX_TAPS) или 0, если серий не было.
+    const Debounce &debouncer() const { return debounce; }                         ///< @brief Стратегия устранения дребезга (например, для чтения параметров AdaptiveDebounce). @return Ссылка на стратегию.
+    bool isIdle() const { return !pressed_f && !tapCount && debounce.isSettled(); } ///< @brief Проверяет, что кнопка отпущена и не ожидает завершения дребезга или серии касаний. @return true, если до следующего фронта состояние не изменится.
+
+    /**
+     * @brief Отменяет события текущего нажатия.
+     * При отпускании не будут сформированы события кратковременного/длительного нажатия и касания,
+     * а незавершённая серия касаний завершается до текущего нажатия.
+     */
+    void suppressCurrentPress()
+    {
+        finishTaps();
+        suppressed_f = pressed_f;
+    }
 
 private:
-    const uint8_t pin;                 ///< Пин, к которому подключена кнопка.
-    const uint32_t debounceDelay;      ///< Задержка для устранения дребезга в микросекундах.
-    const uint32_t longPressThreshold; ///< Порог длительного нажатия в микросекундах.
-    uint64_t lastDebounceTime = 0;     ///< Время последнего изменения состояния кнопки.
-    bool last_pin_value;               ///< Предыдущее состояние пина кнопки (1 бит).
-    bool pressed_f;                    ///< Текущее состояние кнопки (нажата или нет) (1 бит).
-    bool shortPress_f;                 ///< Флаг кратковременного нажатия кнопки (1 бит).
-    bool longPress_f;                  ///< Флаг длительного нажатия кнопки (1 бит).
+    Debounce debounce;                 ///< Стратегия устранения дребезга.
+    uint64_t pressStartTime = 0;       ///< Время начала последнего нажатия (по Debounce::edgeTime()).
+    uint64_t releaseTime = 0;          ///< Время последнего отпускания (по Debounce::edgeTime()).
+    uint32_t pressDuration = 0;        ///< Длительность последнего завершённого нажатия в микросекундах.
+    bool pressed_f = false;            ///< Текущее состояние кнопки (нажата или нет) (1 бит).
+    bool shortPress_f = false;         ///< Флаг кратковременного нажатия кнопки (1 бит).
+    bool longPress_f = false;          ///< Флаг длительного нажатия кнопки (1 бит).
+    bool suppressed_f = false;         ///< Флаг отмены событий текущего нажатия (1 бит).
+    uint8_t tapCount = 0;              ///< Количество касаний в текущей (незавершённой) серии.
+    uint8_t tapEvent = 0;              ///< Длина последней завершённой серии касаний (0 – событие прочитано).
+
+    void finishTaps() { tapEvent = tapCount ? tapCount : tapEvent, tapCount = 0; } ///< @brief Завершает текущую серию касаний и фиксирует событие.
 };
 
+typedef BasicButtonHandler<ButtonConfig> ButtonHandler; ///< Обработчик кнопки с параметрами, задаваемыми при выполнении.
+
+/**
+ * @brief Обработчик кнопки с параметрами, известными при компиляции (см. StaticButtonConfig).
+ */
+template <uint32_t PortBase, uint8_t Bit, uint32_t DebounceUs, uint32_t LongPressUs, uint32_t TapWindowUs = 0, class Debounce = TimestampDebounce>
+using StaticButtonHandler = BasicButtonHandler<StaticButtonConfig<PortBase, Bit, DebounceUs, LongPressUs, TapWindowUs>, Debounce>;
+
 #endif // BUTTON_HANDLER_H 
\ No newline at end of file
@@ -0,0 +1,60 @@
+#ifndef CHORD_DETECTOR_H
+#define CHORD_DETECTOR_H
+
+#include <Arduino.h>
+#include "ButtonHandler.h"
+
+/**
+ * @brief Класс для распознавания одновременного нажатия (аккорда) двух кнопок.
+ *
+ * Аккорд распознаётся, когда обе кнопки нажаты и их нажатия начались с разницей не больше окна
+ * распознавания. События отдельных кнопок для нажатий, вошедших в аккорд, подавляются.
+ * Следующий аккорд возможен только после отпускания обеих кнопок.
+ * @tparam First Тип обработчика первой кнопки (ButtonHandler или StaticButtonHandler).
+ * @tparam Second Тип обработчика второй кнопки.
+ */
+template <class First, class Second = First>
+class ChordDetector
+{
+public:
+    /**
+     * @brief Конструктор класса ChordDetector.
+     * @param first Первая кнопка аккорда.
+     * @param second Вторая кнопка аккорда.
+     * @param chordWindow Окно распознавания аккорда в микросекундах.
+     */
+    ChordDetector(First &first, Second &second, uint32_t chordWindow)
+        : first(first), second(second), chordWindow(chordWindow) {}
+
+    /**
+     * @brief Обновляет состояние аккорда.
+     * Вызывается после обновления состояния обеих кнопок.
+     */
+    void updateState()
+    {
+        bool firstPressed = first.isPressedNow(), secondPressed = second.isPressedNow();
+        if (!active_f && firstPressed && secondPressed)
+        {
+            uint64_t a = first.pressStartTicks(), b = second.pressStartTicks();
+            if ((a > b ? a - b : b - a) <= chordWindow)
+            {
+                first.suppressCurrentPress(), second.suppressCurrentPress();
+                active_f = chord_f = true;
+            }
+        }
+        if (active_f && !firstPressed && !secondPressed)
+            active_f = false;
+    }
+
+    bool isActive() const { return active_f; }                           ///< @brief Проверяет, удерживается ли аккорд. @return true, если аккорд распознан и кнопки ещё не отпущены.
+    bool isChord() { return chord_f ? !(chord_f = false) : false; }      ///< @brief Проверяет, был ли распознан аккорд. @return true, если с прошлой проверки был распознан аккорд, иначе false.
+
+private:
+    First &first;               ///< Первая кнопка аккорда.
+    Second &second;             ///< Вторая кнопка аккорда.
+    const uint32_t chordWindow; ///< Окно распознавания аккорда в микросекундах.
+    bool active_f = false;      ///< Аккорд распознан и удерживается (1 бит).
+    bool chord_f = false;       ///< Флаг распознанного аккорда (1 бит).
+};
+
+#endif // CHORD_DETECTOR_H
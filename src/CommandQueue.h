@@ -0,0 +1,94 @@
+#ifndef COMMAND_QUEUE_H
+#define COMMAND_QUEUE_H
+
+#include <Arduino.h>
+
+/**
+ * @brief Очередь команд I2C без блокировок с одним писателем (обработчик приёма Wire) и одним читателем (задача).
+ *
+ * Писатель копирует принятые байты прямо в свободную ячейку (claim()) и публикует её (commit()),
+ * читатель обрабатывает ячейки по порядку (front()/pop()). Индексы – 8-битные счётчики, ячейка – счётчик
+ * по модулю Depth. При заполненной очереди новая команда отбрасывается (drop(); ранее принятые выполняются
+ * в порядке поступления) и учитывается в счётчике переполнений.
+ *
+ * @tparam Depth Количество ячеек (степень двойки, не больше 128).
+ * @tparam FrameSize Наибольший размер команды в байтах (размер буфера Wire).
+ */
+template <uint8_t Depth, uint8_t FrameSize = 32>
+class CommandQueue
+{
+    static_assert(Depth && !(Depth & (Depth - 1)) && Depth <= 128, "Глубина очереди – степень двойки до 128");
+
+public:
+    /**
+     * @brief Принятая команда.
+     */
+    struct Frame
+    {
+        uint8_t size;            ///< Количество байтов команды.
+        uint8_t data[FrameSize]; ///< Байты команды (первый – код команды).
+    };
+
+    /**
+     * @brief Статистика очереди в том виде, в котором она передаётся по I2C.
+     */
+    struct Stats
+    {
+        uint32_t maxIsrCycles; ///< Худшее время обработчика приёма в тактах.
+        uint8_t depth;         ///< Количество ячеек очереди.
+        uint8_t pending;       ///< Количество команд, ожидающих выполнения.
+        uint8_t maxPending;    ///< Наибольшее количество ожидавших команд.
+        uint8_t overflows;     ///< Количество отброшенных из-за переполнения команд (по модулю 256).
+    };
+
+    /**
+     * @brief Возвращает свободную ячейку для записи команды. Вызывается только писателем.
+     * @return Указатель на ячейку или nullptr, если очередь заполнена.
+     */
+    Frame *claim() { return (uint8_t)(head - tail) < Depth ? &frames[head % Depth] : nullptr; }
+
+    /**
+     * @brief Публикует ячейку, полученную claim(). Вызывается только писателем.
+     */
+    void commit()
+    {
+        __DMB(); // Команда должна быть записана до публикации индекса
+        uint8_t pending = ++head - tail;
+        maxPending = max(maxPending, pending);
+    }
+
+    void drop() { ++overflows; } ///< @brief Учитывает команду, отброшенную из-за заполненной очереди. Вызывается только писателем.
+
+    /**
+     * @brief Возвращает самую старую невыполненную команду. Вызывается только читателем.
+     * @return Указатель на команду или nullptr, если очередь пуста.
+     */
+    const Frame *front() const { return tail != head ? &frames[tail % Depth] : nullptr; }
+
+    /**
+     * @brief Освобождает ячейку команды, полученной front(). Вызывается только читателем.
+     */
+    void pop()
+    {
+        __DMB(); // Команда должна быть прочитана до освобождения ячейки
+        ++tail;
+    }
+
+    void recordIsrCycles(uint32_t cycles) { maxIsrCycles = max(maxIsrCycles, cycles); } ///< @brief Учитывает время обработчика приёма. @param cycles Время в тактах.
+
+    /**
+     * @brief Копирует статистику очереди. Вызывается из прерывания I2C (в контексте писателя).
+     * @param out Приёмник статистики.
+     */
+    void readStats(Stats &out) const { out = {maxIsrCycles, Depth, (uint8_t)(head - tail), maxPending, overflows}; }
+
+private:
+    Frame frames[Depth];       ///< Ячейки очереди.
+    volatile uint8_t head = 0; ///< Счётчик опубликованных команд (пишет только писатель).
+    volatile uint8_t tail = 0; ///< Счётчик выполненных команд (пишет только читатель).
+    uint8_t maxPending = 0;    ///< Наибольшее количество ожидавших команд.
+    uint8_t overflows = 0;     ///< Счётчик отброшенных команд.
+    uint32_t maxIsrCycles = 0; ///< Худшее время обработчика приёма в тактах.
+};
+
+#endif // COMMAND_QUEUE_H
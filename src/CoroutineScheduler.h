@@ -0,0 +1,264 @@
+#ifndef COROUTINE_SCHEDULER_H
+#define COROUTINE_SCHEDULER_H
+
+#include <Arduino.h>
+#include <coroutine>
+#include "SnapshotBuffer.h"
+
+#ifndef COROUTINE_MAX_TASKS
+#define COROUTINE_MAX_TASKS 3 ///< Максимальное количество одновременно существующих сопрограмм.
+#endif
+#ifndef COROUTINE_FRAME_SIZE
+#define COROUTINE_FRAME_SIZE 128 ///< Размер ячейки пула кадров сопрограмм, байт.
+#endif
+
+/**
+ * @brief Статический пул кадров сопрограмм: COROUTINE_MAX_TASKS ячеек по COROUTINE_FRAME_SIZE байт, без кучи.
+ */
+class CoFramePool
+{
+public:
+    /**
+     * @brief Выделяет ячейку под кадр сопрограммы.
+     * @param size Размер кадра, запрошенный компилятором.
+     * @return Указатель на ячейку или nullptr, если кадр не помещается или свободных ячеек нет.
+     */
+    static void *allocate(size_t size)
+    {
+        if (size > COROUTINE_FRAME_SIZE)
+            return nullptr;
+        for (uint8_t i = 0; i < COROUTINE_MAX_TASKS; ++i)
+            if (!(used & (1 << i)))
+                return used |= 1 << i, slots[i];
+        return nullptr;
+    }
+
+    static void release(void *frame) { used &= ~(1 << ((uint8_t(*)[COROUTINE_FRAME_SIZE])frame - slots)); } ///< @brief Освобождает ячейку кадра.
+
+private:
+    alignas(8) static inline uint8_t slots[COROUTINE_MAX_TASKS][COROUTINE_FRAME_SIZE]; ///< Ячейки кадров.
+    static inline uint8_t used = 0;                                                   ///< Маска занятых ячеек.
+};
+
+/**
+ * @brief Базовый класс ожидаемых условий (co_await) сопрограмм.
+ * Объект условия хранится в кадре сопрограммы; планировщик проверяет его готовность на каждом проходе.
+ */
+class CoAwaiter
+{
+public:
+    virtual bool ready(uint32_t tick) = 0; ///< @brief Проверяет выполнение условия. @param tick Номер текущего прохода планировщика. @return true, если сопрограмму можно продолжить.
+
+    bool await_ready();
+    template <typename Promise>
+    void await_suspend(std::coroutine_handle<Promise> handle) { handle.promise().awaiter = this; }
+    void await_resume() {}
+
+protected:
+    ~CoAwaiter() = default;
+};
+
+/**
+ * @brief Тип возвращаемого значения сопрограммы-задачи. Кадр размещается в CoFramePool.
+ */
+class CoTask
+{
+public:
+    struct promise_type
+    {
+        CoAwaiter *awaiter = nullptr; ///< Условие, которого ожидает задача (nullptr – готова к выполнению).
+
+        CoTask get_return_object() { return CoTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        static CoTask get_return_object_on_allocation_failure() { return CoTask(nullptr); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() {}
+        static void *operator new(size_t size) noexcept { return CoFramePool::allocate(size); }
+        static void operator delete(void *frame) noexcept { CoFramePool::release(frame); }
+    };
+    typedef std::coroutine_handle<promise_type> Handle;
+
+    explicit CoTask(Handle handle) : handle(handle) {}
+    CoTask(CoTask &&other) noexcept : handle(other.handle) { other.handle = nullptr; }
+    ~CoTask()
+    {
+        if (handle)
+            handle.destroy();
+    }
+
+    Handle release() { Handle released = handle; return handle = nullptr, released; } ///< @brief Передаёт владение кадром. @return Дескриптор сопрограммы (пустой, если кадр не выделен).
+
+private:
+    Handle handle; ///< Дескриптор сопрограммы.
+};
+
+/**
+ * @brief Кооперативный планировщик бесстековых сопрограмм C++20.
+ *
+ * Вызов run() – один проход: каждая задача, условие ожидания которой выполнено, продолжается до
+ * следующего co_await. Проходы выполняются с частотой тиков TickScheduler, поэтому задержки задаются
+ * в проходах (тиках). Для каждой задачи измеряется время выполнения, для самого планировщика –
+ * накладные расходы прохода без учёта задач; раз в STATS_WINDOW проходов публикуется снимок статистики.
+ */
+class CoScheduler
+{
+public:
+    static const uint16_t STATS_WINDOW = 1000; ///< Окно усреднения статистики, проходов.
+
+    /**
+     * @brief Статистика планировщика в том виде, в котором она передаётся по I2C (little-endian).
+     */
+    struct Stats
+    {
+        uint32_t overheadCycles; ///< Средние накладные расходы прохода без учёта задач, тактов.
+        uint8_t taskCount;       ///< Количество ячеек задач.
+        uint8_t reserved[3];     ///< Выравнивание.
+        struct
+        {
+            uint32_t maxCycles; ///< Худшее время выполнения до следующего co_await, тактов.
+            uint32_t avgCycles; ///< Среднее время выполнения за проход, в котором задача продолжалась, тактов.
+        } tasks[COROUTINE_MAX_TASKS]; ///< Время выполнения задач в порядке запуска.
+    };
+
+    static uint32_t now() { return tick; } ///< @brief Номер текущего прохода. @return Количество выполненных проходов.
+
+    /**
+     * @brief Включает счётчик тактов для измерения времени выполнения.
+     */
+    void begin()
+    {
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+        stats.taskCount = COROUTINE_MAX_TASKS;
+    }
+
+    /**
+     * @brief Добавляет задачу в планировщик.
+     * @param task Сопрограмма-задача.
+     * @return false, если кадр задачи не поместился в пул или нет свободной ячейки.
+     */
+    bool spawn(CoTask &&task)
+    {
+        CoTask::Handle handle = task.release();
+        for (uint8_t i = 0; handle && i < COROUTINE_MAX_TASKS; ++i)
+            if (!tasks[i])
+                return tasks[i] = handle, true;
+        if (handle)
+            handle.destroy();
+        return false;
+    }
+
+    /**
+     * @brief Выполняет один проход: продолжает все задачи с выполненным условием ожидания.
+     */
+    void run()
+    {
+        uint32_t start = DWT->CYCCNT, inTasks = 0;
+        ++tick;
+        for (uint8_t i = 0; i < COROUTINE_MAX_TASKS; ++i)
+        {
+            CoTask::Handle handle = tasks[i];
+            if (!handle || (handle.promise().awaiter && !handle.promise().awaiter->ready(tick)))
+                continue;
+            handle.promise().awaiter = nullptr;
+            uint32_t t0 = DWT->CYCCNT;
+            handle.resume();
+            uint32_t cycles = DWT->CYCCNT - t0;
+            inTasks += cycles, taskCycles[i] += cycles, ++taskRuns[i];
+            stats.tasks[i].maxCycles = max(stats.tasks[i].maxCycles, cycles);
+            if (handle.done())
+                handle.destroy(), tasks[i] = nullptr;
+        }
+        overheadCycles += DWT->CYCCNT - start - inTasks;
+
+        if (tick % STATS_WINDOW == 0)
+        {
+            stats.overheadCycles = overheadCycles / STATS_WINDOW, overheadCycles = 0;
+            for (uint8_t i = 0; i < COROUTINE_MAX_TASKS; ++i)
+                stats.tasks[i].avgCycles = taskRuns[i] ? taskCycles[i] / taskRuns[i] : 0, taskCycles[i] = taskRuns[i] = 0;
+            published.publish(stats);
+        }
+    }
+
+    void readStats(Stats &out) const { published.read(out); } ///< @brief Копирует последний снимок статистики. Безопасно вызывать из прерывания.
+
+private:
+    static inline uint32_t tick = 0;                   ///< Номер текущего прохода.
+    CoTask::Handle tasks[COROUTINE_MAX_TASKS] = {};    ///< Задачи.
+    uint32_t taskCycles[COROUTINE_MAX_TASKS] = {};     ///< Суммарное время задач за окно, тактов.
+    uint32_t taskRuns[COROUTINE_MAX_TASKS] = {};       ///< Количество продолжений задач за окно.
+    uint32_t overheadCycles = 0;                       ///< Накладные расходы за окно, тактов.
+    Stats stats = {};                                  ///< Накапливаемая статистика.
+    SnapshotBuffer<Stats> published;                   ///< Последний опубликованный снимок статистики.
+};
+
+inline bool CoAwaiter::await_ready() { return ready(CoScheduler::now()); }
+
+/**
+ * @brief Ожидание заданного количества проходов планировщика (тиков).
+ */
+class CoSleep : public CoAwaiter
+{
+public:
+    explicit CoSleep(uint32_t ticks) : wakeTick(CoScheduler::now() + ticks) {}
+    bool ready(uint32_t tick) override { return (int32_t)(tick - wakeTick) >= 0; }
+
+private:
+    const uint32_t wakeTick; ///< Проход, на котором задача продолжится.
+};
+
+/**
+ * @brief Ожидание изменения уровня любого из пинов порта (фронта) с ограничением времени ожидания.
+ */
+class CoPinChange : public CoAwaiter
+{
+public:
+    /**
+     * @param port Порт GPIO.
+     * @param mask Маска пинов порта.
+     * @param timeoutTicks Максимальное время ожидания в проходах планировщика.
+     */
+    CoPinChange(GPIO_TypeDef *port, uint32_t mask, uint32_t timeoutTicks)
+        : port(port), mask(mask), initial(port->IDR & mask), deadline(CoScheduler::now() + timeoutTicks) {}
+    bool ready(uint32_t tick) override { return (port->IDR & mask) != initial || (int32_t)(tick - deadline) >= 0; }
+
+private:
+    GPIO_TypeDef *const port; ///< Порт GPIO.
+    const uint32_t mask;      ///< Маска пинов.
+    const uint32_t initial;   ///< Уровни пинов в момент начала ожидания.
+    const uint32_t deadline;  ///< Проход, на котором ожидание прекращается.
+};
+
+/**
+ * @brief Событие, устанавливаемое из прерывания (например, обработчика I2C) и ожидаемое задачей.
+ * Продолжение задачи сбрасывает событие; повторные установки до этого объединяются.
+ */
+class CoEvent
+{
+public:
+    void signal() { set_f = true; } ///< @brief Устанавливает событие. Безопасно вызывать из прерывания.
+
+    class Wait : public CoAwaiter
+    {
+    public:
+        explicit Wait(CoEvent &event) : event(event) {}
+        bool ready(uint32_t) override
+        {
+            if (!event.set_f)
+                return false;
+            event.set_f = false;
+            return true;
+        }
+
+    private:
+        CoEvent &event; ///< Ожидаемое событие.
+    };
+
+    Wait operator co_await() { return Wait(*this); }
+
+private:
+    volatile bool set_f = false; ///< Флаг установленного события (1 бит).
+};
+
+#endif // COROUTINE_SCHEDULER_H
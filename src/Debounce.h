@@ -0,0 +1,288 @@
+#ifndef DEBOUNCE_H
+#define DEBOUNCE_H
+
+#include <Arduino.h>
+
+/**
+ * @file Debounce.h
+ * @brief Стратегии устранения дребезга для BasicButtonHandler и банк вертикальных счётчиков.
+ *
+ * Стратегия получает каждый отсчёт уровня кнопки (true – отпущена) и возвращает установившийся уровень:
+ * - bool update(bool raw, uint64_t ticks, uint32_t debounceDelay) – обработка отсчёта;
+ * - uint64_t edgeTime() const – момент последнего изменения установившегося уровня (мкс);
+ * - bool isSettled() const – нет незавершённого переключения (входной уровень совпадает с установившимся).
+ *
+ * Стратегии на счётчиках отсчётов не зависят от времени, и их задержка определяется частотой вызова
+ * updateState() (1 кГц в прошивке); стратегия по метке времени работает при любой частоте опроса.
+ * Задержка, ложные срабатывания и время обработки отсчёта каждой стратегии на наборе сигналов кнопок
+ * измеряются тестом test/test_debounce_benchmark.cpp.
+ */
+
+/**
+ * @brief Устранение дребезга по метке времени: уровень принимается, если он не менялся debounceDelay мкс.
+ * Момент нажатия/отпускания – последний фронт перед установлением уровня. Состояние – 16 байт.
+ */
+class TimestampDebounce
+{
+public:
+    /**
+     * @brief Обрабатывает отсчёт уровня кнопки.
+     * @param raw Уровень сигнала (true – отпущена).
+     * @param ticks Текущее время в микросекундах.
+     * @param debounceDelay Задержка для устранения дребезга в микросекундах.
+     * @return Установившийся уровень.
+     */
+    bool update(bool raw, uint64_t ticks, uint32_t debounceDelay)
+    {
+        if (raw != lastRaw)
+            lastRaw = raw, lastChangeTime = ticks;
+        if (ticks >= lastChangeTime + debounceDelay)
+            level = raw;
+        return level;
+    }
+
+    uint64_t edgeTime() const { return lastChangeTime; } ///< @brief Момент последнего фронта входного уровня. @return Время в микросекундах.
+    bool isSettled() const { return lastRaw == level; }  ///< @brief Проверяет отсутствие незавершённого переключения. @return true, если входной уровень совпадает с установившимся.
+
+private:
+    uint64_t lastChangeTime = 0; ///< Время последнего изменения входного уровня.
+    bool lastRaw = false;        ///< Предыдущий входной уровень (1 бит).
+    bool level = true;           ///< Установившийся уровень (1 бит).
+};
+
+/**
+ * @brief Адаптивное устранение дребезга по метке времени: задержка подстраивается под наблюдаемый дребезг кнопки.
+ *
+ * Пачка фронтов начинается с первого фронта после установившегося состояния и заканчивается, когда уровень
+ * не меняется рабочую задержку: фильтр принимает новый уровень, и длительность дребезга – от первого
+ * до последнего фронта пачки перед принятием. Поэтому короткое нажатие, принятое при текущей задержке,
+ * учитывается как нажатие, а его отпускание – как следующая пачка, а не как дребезг нажатия. Пачка, после
+ * которой уровень вернулся к установившемуся, – помеха и не учитывается, если только она не началась в пределах
+ * рабочей задержки после принятия уровня: тогда это продолжение дребезга, и учитывается вся длительность
+ * от первого фронта принятой пачки. По последним HISTORY пачкам берётся максимум (высокий процентиль),
+ * и рабочая задержка равна 1.5 × максимум + MarginUs в пределах [MinUs, debounceDelay]. До накопления HISTORY
+ * наблюдений используется debounceDelay. Состояние – 64 байта.
+ * @tparam MinUs Нижняя граница рабочей задержки в микросекундах.
+ * @tparam MarginUs Запас над наблюдаемым дребезгом в микросекундах.
+ */
+template <uint32_t MinUs = 3000, uint32_t MarginUs = 2000>
+class AdaptiveDebounce
+{
+public:
+    static const uint8_t HISTORY = 8; ///< Количество последних пачек дребезга, по которым оценивается процентиль.
+
+    /**
+     * @brief Обрабатывает отсчёт уровня кнопки.
+     * @param raw Уровень сигнала (true – отпущена).
+     * @param ticks Текущее время в микросекундах.
+     * @param debounceDelay Верхняя граница задержки в микросекундах.
+     * @return Установившийся уровень.
+     */
+    bool update(bool raw, uint64_t ticks, uint32_t debounceDelay)
+    {
+        if (raw != lastRaw)
+        {
+            if (!bursting_f)
+                bursting_f = true, burstStart = ticks;
+            lastRaw = raw, lastChangeTime = ticks;
+        }
+        uint32_t delay = effectiveDelay(debounceDelay);
+        if (bursting_f && ticks >= lastChangeTime + delay)
+        {
+            bursting_f = false;
+            if (raw != level) // Новый уровень принят: дребезг – фронты до принятия
+                level = raw, acceptTime = ticks, acceptedStart = burstStart, learn(lastChangeTime - burstStart, debounceDelay);
+            else if (burstStart < acceptTime + delay) // Дребезг продолжился после принятия уровня
+                learn(lastChangeTime - acceptedStart, debounceDelay);
+        }
+        return level;
+    }
+
+    uint64_t edgeTime() const { return lastChangeTime; }                        ///< @brief Момент последнего фронта входного уровня. @return Время в микросекундах.
+    bool isSettled() const { return lastRaw == level && !bursting_f; }          ///< @brief Проверяет отсутствие незавершённого переключения и пачки дребезга. @return true, если состояние не изменится до следующего фронта.
+    uint32_t effectiveDelay(uint32_t debounceDelay) const { return effective ? effective : debounceDelay; } ///< @brief Рабочая задержка. @param debounceDelay Верхняя граница в микросекундах. @return Задержка в микросекундах.
+    uint16_t bounceEstimate() const { return estimate; }                        ///< @brief Оценка длительности дребезга (максимум по HISTORY пачкам). @return Длительность в микросекундах.
+    uint16_t observations() const { return observed; }                          ///< @brief Количество наблюдённых пачек дребезга (с насыщением). @return Счётчик пачек.
+
+private:
+    /**
+     * @brief Учитывает длительность очередной пачки дребезга и пересчитывает рабочую задержку.
+     * @param bounce Длительность пачки в микросекундах.
+     * @param debounceDelay Верхняя граница задержки в микросекундах.
+     */
+    void learn(uint64_t bounce, uint32_t debounceDelay)
+    {
+        history[next] = bounce < 0xFFFF ? bounce : 0xFFFF;
+        next = (next + 1) % HISTORY;
+        if (observed < 0xFFFF)
+            ++observed;
+        estimate = 0;
+        for (uint8_t i = 0; i < HISTORY; ++i)
+            estimate = max(estimate, history[i]);
+        if (observed >= HISTORY)
+            effective = constrain(estimate * 3UL / 2 + MarginUs, min(MinUs, debounceDelay), debounceDelay);
+    }
+
+    uint64_t lastChangeTime = 0;     ///< Время последнего изменения входного уровня.
+    uint64_t burstStart = 0;         ///< Время первого фронта текущей пачки дребезга.
+    uint64_t acceptedStart = 0;      ///< Время первого фронта пачки, уровень которой принят последним.
+    uint64_t acceptTime = 0;         ///< Время принятия последнего уровня.
+    uint32_t effective = 0;          ///< Рабочая задержка в микросекундах (0 – ещё не определена).
+    uint16_t history[HISTORY] = {};  ///< Длительности последних пачек дребезга в микросекундах.
+    uint16_t estimate = 0;           ///< Максимум длительностей в history.
+    uint16_t observed = 0;           ///< Количество наблюдённых пачек.
+    uint8_t next = 0;                ///< Индекс следующей записи в history.
+    bool lastRaw = true;             ///< Предыдущий входной уровень (1 бит).
+    bool level = true;               ///< Установившийся уровень (1 бит).
+    bool bursting_f = false;         ///< Идёт пачка дребезга (1 бит).
+};
+
+/**
+ * @brief Интегратор: счётчик отсчётов движется к 0 или Samples по каждому отсчёту, уровень меняется на краях.
+ * Одиночные выбросы лишь отодвигают переключение, не сбрасывая его. Момент нажатия/отпускания –
+ * момент принятия решения (включает задержку фильтра). Состояние – 16 байт (8 из них – метка времени).
+ * @tparam Samples Количество отсчётов до переключения (1..255).
+ */
+template <uint8_t Samples>
+class IntegratorDebounce
+{
+public:
+    bool update(bool raw, uint64_t ticks, uint32_t) ///< @brief Обрабатывает отсчёт уровня кнопки (задержка в мкс не используется). @return Установившийся уровень.
+    {
+        if (raw && count < Samples)
+            ++count;
+        else if (!raw && count)
+            --count;
+        if (level != raw && count == (raw ? Samples : 0))
+            level = raw, edge = ticks;
+        return level;
+    }
+
+    uint64_t edgeTime() const { return edge; }                        ///< @brief Момент последнего переключения. @return Время в микросекундах.
+    bool isSettled() const { return count == (level ? Samples : 0); } ///< @brief Проверяет отсутствие незавершённого переключения. @return true, если счётчик на краю установившегося уровня.
+
+private:
+    uint64_t edge = 0;       ///< Момент последнего переключения.
+    uint8_t count = Samples; ///< Счётчик интегратора.
+    bool level = true;       ///< Установившийся уровень (1 бит).
+};
+
+/**
+ * @brief Сдвиговый регистр: уровень меняется, когда последние Samples отсчётов совпадают.
+ * Любой выброс перезапускает ожидание. Момент нажатия/отпускания – момент принятия решения.
+ * Состояние – 16 байт (8 из них – метка времени).
+ * @tparam Samples Длина совпадающей последовательности отсчётов (1..32).
+ */
+template <uint8_t Samples>
+class ShiftRegisterDebounce
+{
+    static_assert(Samples >= 1 && Samples <= 32, "История хранится в 32-битном регистре");
+
+public:
+    bool update(bool raw, uint64_t ticks, uint32_t) ///< @brief Обрабатывает отсчёт уровня кнопки (задержка в мкс не используется). @return Установившийся уровень.
+    {
+        history = (history << 1) | raw;
+        if ((history & MASK) == (level ? 0 : MASK))
+            level = !level, edge = ticks;
+        return level;
+    }
+
+    uint64_t edgeTime() const { return edge; }                                ///< @brief Момент последнего переключения. @return Время в микросекундах.
+    bool isSettled() const { return (history & MASK) == (level ? MASK : 0); } ///< @brief Проверяет отсутствие незавершённого переключения. @return true, если вся история совпадает с установившимся уровнем.
+
+private:
+    static const uint32_t MASK = Samples == 32 ? 0xFFFFFFFFUL : (1UL << Samples) - 1; ///< Маска учитываемой истории.
+    uint64_t edge = 0;             ///< Момент последнего переключения.
+    uint32_t history = 0xFFFFFFFF; ///< Последние отсчёты (младший бит – последний).
+    bool level = true;             ///< Установившийся уровень (1 бит).
+};
+
+/**
+ * @brief Без устранения дребезга: для уровней, уже отфильтрованных снаружи (например, VerticalCounterBank).
+ * Момент нажатия/отпускания – момент изменения уровня. Состояние – 16 байт.
+ */
+class PassThroughDebounce
+{
+public:
+    bool update(bool raw, uint64_t ticks, uint32_t) ///< @brief Принимает уровень без изменений. @return Уровень сигнала.
+    {
+        if (raw != level)
+            level = raw, edge = ticks;
+        return level;
+    }
+
+    uint64_t edgeTime() const { return edge; } ///< @brief Момент последнего изменения уровня. @return Время в микросекундах.
+    bool isSettled() const { return true; }    ///< @brief Незавершённых переключений не бывает. @return true.
+
+private:
+    uint64_t edge = 0; ///< Момент последнего изменения уровня.
+    bool level = true; ///< Текущий уровень (1 бит).
+};
+
+/**
+ * @brief Банк из 32 вертикальных счётчиков: параллельное устранение дребезга до 32 входов, опрашиваемых вместе
+ * (например, кадр сдвиговых регистров). Для каждого входа – 2-битный счётчик, разнесённый по двум словам:
+ * уровень меняется после 4 подряд отсчётов, отличных от установившегося, любой совпадающий отсчёт сбрасывает
+ * счётчик. Обработка отсчёта – 7 логических операций на все входы сразу, состояние – 12 байт на 32 входа.
+ */
+class VerticalCounterBank
+{
+public:
+    /**
+     * @brief Конструктор класса VerticalCounterBank.
+     * @param initial Начальные установившиеся уровни входов.
+     */
+    explicit VerticalCounterBank(uint32_t initial = 0xFFFFFFFF) : levels(initial) {}
+
+    /**
+     * @brief Обрабатывает отсчёт всех входов.
+     * @param raw Уровни входов (бит на вход).
+     * @return Установившиеся уровни входов.
+     */
+    uint32_t update(uint32_t raw)
+    {
+        uint32_t differs = levels ^ raw;              // Входы, уровень которых отличается от установившегося
+        count0 = ~(count0 & differs);                 // Младший бит счётчика: сброс в 1 при совпадении, иначе счёт
+        count1 = count0 ^ (count1 & differs);         // Старший бит счётчика
+        uint32_t toggled = differs & count0 & count1; // Счётчик прошёл 4 отсчёта (переполнение 0 -> 3)
+        levels ^= toggled;
+        return levels;
+    }
+
+    uint32_t state() const { return levels; } ///< @brief Установившиеся уровни входов. @return Бит на вход.
+
+private:
+    uint32_t levels;              ///< Установившиеся уровни входов.
+    uint32_t count0 = 0xFFFFFFFF; ///< Младшие биты счётчиков.
+    uint32_t count1 = 0xFFFFFFFF; ///< Старшие биты счётчиков.
+};
+
+/**
+ * @brief Вертикальный счётчик для одной кнопки: та же логика, что у линии VerticalCounterBank (уровень меняется
+ * после 4 подряд отсчётов, отличных от установившегося). Позволяет выбрать фильтр банка для отдельной кнопки,
+ * например чтобы сравнить его со стратегиями по метке времени. Момент нажатия/отпускания – момент принятия решения.
+ * Состояние – 24 байта (8 из них – метка времени).
+ */
+class VerticalCounterDebounce
+{
+public:
+    bool update(bool raw, uint64_t ticks, uint32_t) ///< @brief Обрабатывает отсчёт уровня кнопки (задержка в мкс не используется). @return Установившийся уровень.
+    {
+        bool before = bank.state() & 1;
+        bool level = bank.update(raw ? 0xFFFFFFFF : 0) & 1; // Все линии банка получают один и тот же отсчёт
+        if (level != before)
+            edge = ticks;
+        lastRaw = raw;
+        return level;
+    }
+
+    uint64_t edgeTime() const { return edge; }                       ///< @brief Момент последнего переключения. @return Время в микросекундах.
+    bool isSettled() const { return lastRaw == (bank.state() & 1); } ///< @brief Проверяет отсутствие незавершённого переключения. @return true, если последний отсчёт совпадает с установившимся уровнем.
+
+private:
+    uint64_t edge = 0;        ///< Момент последнего переключения.
+    VerticalCounterBank bank; ///< Банк, из которого используется одна линия.
+    bool lastRaw = true;      ///< Последний отсчёт (1 бит).
+};
+
+#endif // DEBOUNCE_H
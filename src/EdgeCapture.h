@@ -0,0 +1,134 @@
+#ifndef EDGE_CAPTURE_H
+#define EDGE_CAPTURE_H
+
+#include <Arduino.h>
+
+/**
+ * @brief Захват фронтов кнопок каналами 1 и 2 аппаратного таймера (input capture) с цифровым входным фильтром.
+ *
+ * Таймер считает с частотой 1 МГц, и момент фронта фиксируется аппаратно в регистре CCRx, поэтому метка
+ * времени не зависит от периода опроса и задержки прерывания (точность – 1 мкс). Входной фильтр таймера
+ * (ICxF при fDTS = fCK/4) отбрасывает импульсы короче ~14 мкс ещё до программной обработки дребезга.
+ * STM32F1 захватывает только один фронт, поэтому после каждого захвата полярность переключается
+ * по текущему уровню пина; если за время до прерывания произошёл противоположный фронт, он добавляется
+ * с меткой момента обработки. Фронты передаются основному циклу через кольцевой буфер.
+ * Пины кнопок должны быть каналами 1 и 2 таймера (например, PA6/PA7 для TIM3).
+ */
+class EdgeCapture
+{
+public:
+    static const uint8_t CHANNELS = 2;    ///< Количество каналов захвата.
+    static const uint8_t QUEUE_SIZE = 16; ///< Ёмкость буфера фронтов (степень двойки).
+
+    /**
+     * @brief Захваченный фронт.
+     */
+    struct Edge
+    {
+        uint32_t micros; ///< Момент фронта по micros(), мкс.
+        uint8_t channel; ///< Канал (0 – канал 1 таймера, 1 – канал 2).
+        bool level;      ///< Уровень после фронта (true – высокий).
+    };
+
+    /**
+     * @brief Конструктор класса EdgeCapture.
+     * @param instance Таймер, каналы 1 и 2 которого подключены к кнопкам.
+     * @param pin1 Пин канала 1.
+     * @param pin2 Пин канала 2.
+     * @param filter Код цифрового входного фильтра таймера (0–15, ICxF).
+     */
+    EdgeCapture(TIM_TypeDef *instance, uint8_t pin1, uint8_t pin2, uint8_t filter = 0x0F)
+        : instance(instance), pins{pin1, pin2}, filter(filter) {}
+
+    /**
+     * @brief Настраивает каналы захвата и запускает таймер.
+     */
+    void begin()
+    {
+        timer = new HardwareTimer(instance);
+        timer->setPrescaleFactor(timer->getTimerClkFreq() / 1000000); // 1 МГц
+        timer->setOverflow(0x10000);
+        for (uint8_t ch = 0; ch < CHANNELS; ++ch)
+        {
+            pinMode(pins[ch], INPUT_PULLUP); // На STM32F1 вход канала таймера – обычный вход GPIO
+            port[ch] = digitalPinToPort(pins[ch]), mask[ch] = digitalPinToBitMask(pins[ch]);
+            levels[ch] = port[ch]->IDR & mask[ch];
+            timer->setMode(ch + 1, levels[ch] ? TIMER_INPUT_CAPTURE_FALLING : TIMER_INPUT_CAPTURE_RISING);
+            timer->attachInterrupt(ch + 1, [this, ch] { onCapture(ch); });
+        }
+        instance->CCMR1 |= (filter << TIM_CCMR1_IC1F_Pos) | (filter << TIM_CCMR1_IC2F_Pos);
+        instance->CR1 |= TIM_CR1_CKD_1; // fDTS = fCK / 4: фильтр 15 – 8 отсчётов на fDTS / 32
+        timer->resume();
+    }
+
+    /**
+     * @brief Извлекает очередной фронт из буфера. Вызывается из основного цикла.
+     * @param edge Приёмник фронта.
+     * @return false, если буфер пуст.
+     */
+    bool takeEdge(Edge &edge)
+    {
+        if (tail == head)
+            return false;
+        edge = queue[tail % QUEUE_SIZE];
+        __DMB(); // Фронт должен быть прочитан до освобождения ячейки
+        ++tail;
+        levels[edge.channel] = edge.level;
+        return true;
+    }
+
+    bool level(uint8_t channel) const { return levels[channel]; } ///< @brief Уровень канала после последнего извлечённого фронта. @return true – высокий.
+    uint32_t droppedEdges() const { return dropped; }             ///< @brief Количество фронтов, потерянных из-за переполнения буфера. @return Счётчик фронтов.
+
+private:
+    /**
+     * @brief Обработчик захвата канала. Вызывается из прерывания таймера.
+     * @param ch Канал (0 или 1).
+     */
+    void onCapture(uint8_t ch)
+    {
+        uint16_t captured = ch ? instance->CCR2 : instance->CCR1;
+        uint32_t now = micros();
+        uint16_t age = instance->CNT - captured; // Время от фронта до обработки, мкс
+        const uint32_t polarity = ch ? TIM_CCER_CC2P : TIM_CCER_CC1P;
+        bool edgeLevel = !(instance->CCER & polarity); // Спадающий фронт – низкий уровень
+        push(ch, edgeLevel, now - age);
+
+        bool pinLevel = port[ch]->IDR & mask[ch];
+        if (pinLevel != edgeLevel)
+            push(ch, pinLevel, now); // Противоположный фронт произошёл до переключения полярности
+        if (pinLevel)
+            instance->CCER |= polarity; // Ожидаем спадающий фронт
+        else
+            instance->CCER &= ~polarity; // Ожидаем нарастающий фронт
+    }
+
+    /**
+     * @brief Добавляет фронт в буфер. Вызывается из прерывания.
+     */
+    void push(uint8_t ch, bool edgeLevel, uint32_t time)
+    {
+        if ((uint8_t)(head - tail) >= QUEUE_SIZE)
+        {
+            ++dropped;
+            return;
+        }
+        queue[head % QUEUE_SIZE] = {time, ch, edgeLevel};
+        __DMB(); // Фронт должен быть записан до публикации
+        ++head;
+    }
+
+    TIM_TypeDef *const instance;         ///< Таймер захвата.
+    const uint8_t pins[CHANNELS];        ///< Пины каналов.
+    const uint8_t filter;                ///< Код входного фильтра.
+    HardwareTimer *timer = nullptr;      ///< Обёртка таймера (обработчик прерывания).
+    GPIO_TypeDef *port[CHANNELS] = {};   ///< Порты пинов каналов.
+    uint32_t mask[CHANNELS] = {};        ///< Маски пинов каналов.
+    Edge queue[QUEUE_SIZE];              ///< Кольцевой буфер фронтов.
+    volatile uint8_t head = 0;           ///< Счётчик записанных фронтов.
+    volatile uint8_t tail = 0;           ///< Счётчик прочитанных фронтов.
+    bool levels[CHANNELS] = {};          ///< Уровни каналов после последнего извлечённого фронта.
+    volatile uint32_t dropped = 0;       ///< Счётчик потерянных фронтов.
+};
+
+#endif // EDGE_CAPTURE_H
@@ -0,0 +1,83 @@
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+
+#include <Arduino.h>
+
+/**
+ * @brief Журнал событий с номерами последовательности и явным подтверждением для повторяемого чтения.
+ *
+ * Писатель (основной цикл) добавляет записи, читатель (обработчик прерывания I2C) копирует их без удаления:
+ * запись удаляется только после подтверждения её номера ведущим, поэтому потерянный ответ можно запросить повторно.
+ * Номера записей – 16-битные, сквозные; индекс в кольцевом буфере – номер по модулю Capacity.
+ * При заполненном журнале новые записи отбрасываются и учитываются в счётчике потерь.
+ *
+ * @tparam T Тип записи (тривиально копируемая структура).
+ * @tparam Capacity Ёмкость журнала (степень двойки, не больше 256).
+ */
+template <typename T, uint16_t Capacity>
+class EventLog
+{
+    static_assert(Capacity && !(Capacity & (Capacity - 1)) && Capacity <= 256, "Ёмкость журнала – степень двойки до 256");
+
+public:
+    /**
+     * @brief Добавляет запись. Вызывается только из одного контекста (писателя).
+     * @param entry Новая запись.
+     * @return Номер записи или, если журнал заполнен, номер, который она получила бы (запись отброшена).
+     */
+    uint16_t push(const T &entry)
+    {
+        uint16_t seq = head;
+        if ((uint16_t)(seq - tail) >= Capacity)
+            return ++dropped, seq;
+        entries[seq % Capacity] = entry;
+        __DMB(); // Запись должна быть сформирована до публикации номера
+        head = seq + 1;
+        return seq;
+    }
+
+    /**
+     * @brief Копирует неподтверждённые записи, не удаляя их. Безопасно вызывать из прерывания.
+     * @param from Номер первой запрашиваемой записи; если он вне неподтверждённых записей – чтение с самой старой.
+     * @param out Приёмник записей.
+     * @param max Наибольшее количество копируемых записей.
+     * @param first Номер первой скопированной записи.
+     * @return Количество скопированных записей.
+     */
+    uint8_t read(uint16_t from, T *out, uint8_t max, uint16_t &first) const
+    {
+        uint16_t oldest = tail, end = head;
+        if ((uint16_t)(from - oldest) > (uint16_t)(end - oldest))
+            from = oldest; // Запрошенные записи уже подтверждены или ещё не созданы
+        uint8_t count = 0;
+        for (first = from; from != end && count < max; ++from)
+            out[count++] = entries[from % Capacity];
+        return count;
+    }
+
+    /**
+     * @brief Удаляет записи до указанной включительно. Безопасно вызывать из прерывания.
+     * @param seq Номер последней обработанной ведущим записи; номера вне неподтверждённых записей игнорируются.
+     * @return true, если подтверждение принято.
+     */
+    bool acknowledge(uint16_t seq)
+    {
+        uint16_t oldest = tail;
+        if ((uint16_t)(seq - oldest) >= (uint16_t)(head - oldest))
+            return false;
+        tail = seq + 1;
+        return true;
+    }
+
+    uint16_t oldestSequence() const { return tail; } ///< @brief Номер самой старой неподтверждённой записи.
+    uint16_t nextSequence() const { return head; }   ///< @brief Номер, который получит следующая запись.
+    uint8_t droppedCount() const { return dropped; } ///< @brief Количество отброшенных из-за переполнения записей (по модулю 256).
+
+private:
+    T entries[Capacity] = {};     ///< Кольцевой буфер записей.
+    volatile uint16_t head = 0;   ///< Номер следующей записи (пишет только писатель).
+    volatile uint16_t tail = 0;   ///< Номер самой старой неподтверждённой записи (пишет только читатель).
+    volatile uint8_t dropped = 0; ///< Счётчик отброшенных записей.
+};
+
+#endif // EVENT_LOG_H
@@ -0,0 +1,312 @@
+#ifndef FLASH_STORE_H
+#define FLASH_STORE_H
+
+#include <Arduino.h>
+
+extern uint32_t _sidata, _sdata, _edata; // Символы скрипта компоновщика: конец образа прошивки во flash
+
+/**
+ * @brief Встроенная flash-память STM32F1: стирание страницы и запись полуслова через HAL.
+ *
+ * На время стирания (~20 мс) и записи (~50 мкс) выборка команд из flash останавливается – вместе
+ * с обработчиками прерываний; модуль I2C в это время растягивает SCL, транзакции не теряются.
+ */
+struct Stm32Flash
+{
+    static const uint16_t PAGE_SIZE = FLASH_PAGE_SIZE; ///< Размер страницы стирания, байт.
+
+    static uint16_t read(uint32_t address) { return *(volatile const uint16_t *)(uintptr_t)address; } ///< @brief Читает полуслово.
+
+    /**
+     * @brief Проверяет, что адрес находится за образом прошивки (страница не занята кодом и данными).
+     * @param address Адрес начала страницы.
+     */
+    static bool isFree(uint32_t address) { return address >= (uintptr_t)&_sidata + ((uintptr_t)&_edata - (uintptr_t)&_sdata); }
+
+    /**
+     * @brief Стирает страницу.
+     * @param address Адрес начала страницы.
+     */
+    static void erase(uint32_t address)
+    {
+        FLASH_EraseInitTypeDef erase = {};
+        uint32_t error;
+        erase.TypeErase = FLASH_TYPEERASE_PAGES, erase.PageAddress = address, erase.NbPages = 1;
+        HAL_FLASH_Unlock();
+        HAL_FLASHEx_Erase(&erase, &error);
+        HAL_FLASH_Lock();
+    }
+
+    /**
+     * @brief Записывает полуслово в стёртую ячейку (или 0x0000 в любую).
+     * @param address Адрес полуслова.
+     * @param value Значение.
+     */
+    static void program(uint32_t address, uint16_t value)
+    {
+        HAL_FLASH_Unlock();
+        HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, address, value);
+        HAL_FLASH_Lock();
+    }
+};
+
+/**
+ * @brief Хранилище настроек "ключ – значение" в двух страницах flash с журнальной записью и выравниванием износа.
+ *
+ * Значения читаются из копии в RAM за постоянное время (в том числе из прерывания). write() только обновляет копию
+ * и отмечает ключ; запись во flash выполняет service() в задаче планировщика – не больше одной операции за вызов:
+ * добавление записи в конец активной страницы или шаг уплотнения. Каждая запись занимает новую ячейку,
+ * страница стирается только при уплотнении, и страницы стираются по очереди. Стирание (~20 мс) выполняется только
+ * в вызове, разрешающем его (например, при свободной шине); до этого уплотнение и новые записи во flash ждут.
+ *
+ * Формат страницы: заголовок (поколение, его дополнение, признак завершения, резерв), затем записи по 4 байта
+ * (значение, затем ключ в младшем байте и его дополнение в старшем). Запись ключа после значения и проверка
+ * дополнений отбрасывают записи и заголовки, повреждённые сбросом во время записи или стирания.
+ *
+ * Уплотнение: стирание другой страницы (если она не пуста), затем копирование в неё последних значений всех ключей
+ * (по одной записи за вызов) и заголовок с поколением на единицу больше и признаком завершения (отдельным вызовом).
+ * Худший вызов без стирания – запись заголовка, три полуслова (~150 мкс). Старая страница не стирается
+ * до следующего уплотнения, поэтому при сбросе на любом шаге одна из страниц остаётся целой: при запуске выбирается завершённая страница
+ * с целым заголовком и большим поколением.
+ *
+ * @tparam Flash Доступ к flash-памяти (Stm32Flash).
+ * @tparam KeyCount Количество ключей (не больше 32).
+ */
+template <class Flash, uint8_t KeyCount>
+class FlashStore
+{
+    static_assert(KeyCount && KeyCount <= 32, "Количество ключей – от 1 до 32");
+
+public:
+    static const uint16_t SLOTS = (Flash::PAGE_SIZE - 8) / 4; ///< Количество записей на странице.
+
+    /**
+     * @brief Статистика хранилища в том виде, в котором она передаётся по I2C (little-endian).
+     */
+    struct Stats
+    {
+        uint32_t maxStallCycles; ///< Худшее время одного вызова service() (запись или шаг уплотнения), тактов.
+        uint16_t generation;     ///< Поколение активной страницы (количество уплотнений с форматирования).
+        uint16_t erases;         ///< Количество стираний страниц с момента запуска.
+        uint16_t writes;         ///< Количество записей во flash с момента запуска (без копирования при уплотнении).
+        uint16_t used;           ///< Количество занятых записей активной страницы.
+        uint16_t slots;          ///< Количество записей на странице.
+        uint8_t pending;         ///< Количество ключей, ожидающих записи во flash.
+        uint8_t enabled;         ///< 1, если страницы свободны от прошивки и хранилище работает.
+    };
+
+    /**
+     * @brief Конструктор класса FlashStore.
+     * @param page0 Адрес первой страницы.
+     * @param page1 Адрес второй страницы.
+     */
+    FlashStore(uint32_t page0, uint32_t page1) : pages{page0, page1} {}
+
+    /**
+     * @brief Выбирает активную страницу (при необходимости форматирует) и загружает значения в RAM.
+     * Вызывается один раз при запуске.
+     * @return false, если страницы заняты прошивкой: значения не сохраняются, write() меняет только копию в RAM.
+     */
+    bool begin()
+    {
+        if (!Flash::isFree(min(pages[0], pages[1])))
+            return false;
+        int8_t chosen = -1;
+        for (uint8_t page = 0; page < 2; ++page)
+            if (isComplete(pages[page]) && (chosen < 0 || (int16_t)(generationOf(pages[page]) - generationOf(pages[chosen])) > 0))
+                chosen = page;
+        if (chosen < 0) // Первый запуск или обе страницы повреждены
+        {
+            eraseIfUsed(pages[0]), eraseIfUsed(pages[1]);
+            writeHeader(pages[0], 0);
+            chosen = 0;
+        }
+        active = chosen, generation = generationOf(pages[active]);
+        for (used = 0; used < SLOTS; ++used)
+        {
+            uint32_t slot = slotAddress(pages[active], used);
+            uint16_t value = Flash::read(slot), key = Flash::read(slot + 2);
+            if (value == 0xFFFF && key == 0xFFFF)
+                break; // Записи добавляются подряд: дальше страница пуста
+            if ((key >> 8) == (uint8_t)~key && (key & 0xFF) < KeyCount)
+                values[key & 0xFF] = value, present |= 1UL << (key & 0xFF); // Неполные записи пропускаются
+        }
+        enabled = true;
+        return true;
+    }
+
+    /**
+     * @brief Читает значение из копии в RAM. Безопасно вызывать из прерывания.
+     * @param key Ключ.
+     * @param value Приёмник значения.
+     * @return false, если значение не задавалось.
+     */
+    bool read(uint8_t key, uint16_t &value) const
+    {
+        if (key >= KeyCount || !(present >> key & 1))
+            return false;
+        value = values[key];
+        return true;
+    }
+
+    bool isPending(uint8_t key) const { return key < KeyCount && (dirty >> key & 1); } ///< @brief Проверяет, ожидает ли значение записи во flash.
+
+    /**
+     * @brief Задаёт значение: обновляет копию в RAM и откладывает запись во flash до service().
+     * Вызывается из задачи (в одном контексте с service()). Повторная запись того же значения не изнашивает flash.
+     * @param key Ключ.
+     * @param value Значение.
+     * @return false, если ключ вне диапазона.
+     */
+    bool write(uint8_t key, uint16_t value)
+    {
+        if (key >= KeyCount)
+            return false;
+        if (!(present >> key & 1) || values[key] != value)
+            values[key] = value, present |= 1UL << key, dirty |= enabled ? 1UL << key : 0, copied &= ~(1UL << key);
+        return true;
+    }
+
+    /**
+     * @brief Выполняет одну отложенную операцию с flash. Вызывается задачей планировщика (не из прерывания).
+     * @param mayErase false, если стирать страницу сейчас нельзя: шаг уплотнения со стиранием откладывается.
+     */
+    void service(bool mayErase)
+    {
+        if (!dirty && step == IDLE)
+            return;
+        uint32_t start = DWT->CYCCNT;
+        uint32_t target = pages[active ^ 1];
+        switch (step)
+        {
+        case IDLE:
+            if (used < SLOTS)
+            {
+                uint8_t key = __builtin_ctz(dirty);
+                writeRecord(pages[active], used++, key, values[key]);
+                dirty &= ~(1UL << key), ++writes;
+                break;
+            }
+            step = ERASE_TARGET; // Страница заполнена – уплотнение в два вызова: стирание, затем копирование
+            /* fall through */
+        case ERASE_TARGET:
+            if (isUsed(target))
+            {
+                if (!mayErase)
+                    return;
+                Flash::erase(target), ++erases;
+            }
+            step = COPY, copyKey = 0, copySlot = 0, copied = 0;
+            break;
+        case COPY: // Одна запись за вызов; ключ, изменённый после копирования, останется ожидающим
+            while (copyKey < KeyCount && !(present >> copyKey & 1))
+                ++copyKey;
+            if (copyKey < KeyCount)
+            {
+                writeRecord(target, copySlot++, copyKey, values[copyKey]);
+                copied |= 1UL << copyKey++;
+                break;
+            }
+            writeHeader(target, generation + 1); // Признак завершения – после всех записей
+            active ^= 1, ++generation, used = copySlot, dirty &= ~copied, step = IDLE;
+            break;
+        }
+        maxStallCycles = max(maxStallCycles, DWT->CYCCNT - start);
+    }
+
+    /**
+     * @brief Копирует статистику хранилища. Безопасно вызывать из прерывания.
+     * @param out Приёмник статистики.
+     */
+    void readStats(Stats &out) const
+    {
+        out = {maxStallCycles, generation, erases, writes, used, SLOTS, (uint8_t)__builtin_popcount(dirty), enabled};
+    }
+
+    /**
+     * @brief Худшее время одного вызова service() в микросекундах (с насыщением). Безопасно вызывать из прерывания.
+     */
+    uint16_t maxStallUs() const
+    {
+        return min<uint32_t>(maxStallCycles / (SystemCoreClock / 1000000), 0xFFFF);
+    }
+
+private:
+    /**
+     * @brief Шаг отложенной работы service().
+     */
+    enum Step : uint8_t
+    {
+        IDLE,         ///< Добавление записей в активную страницу.
+        ERASE_TARGET, ///< Уплотнение: стирание другой страницы.
+        COPY,         ///< Уплотнение: копирование значений по одному, затем признак завершения.
+    };
+
+    static uint32_t slotAddress(uint32_t page, uint16_t slot) { return page + 8 + slot * 4; } ///< @brief Адрес записи на странице.
+    static uint16_t generationOf(uint32_t page) { return Flash::read(page); }                  ///< @brief Поколение страницы.
+
+    /**
+     * @brief Проверяет, что уплотнение в страницу завершено, а заголовок не повреждён.
+     * @param page Адрес страницы.
+     */
+    static bool isComplete(uint32_t page)
+    {
+        return (uint16_t)~Flash::read(page) == Flash::read(page + 2) && Flash::read(page + 4) == 0x0000;
+    }
+
+    /**
+     * @brief Записывает поколение и признак завершения страницы (после её записей).
+     * @param page Адрес страницы.
+     * @param gen Поколение.
+     */
+    static void writeHeader(uint32_t page, uint16_t gen) { Flash::program(page, gen), Flash::program(page + 2, ~gen), Flash::program(page + 4, 0x0000); }
+
+    /**
+     * @brief Записывает запись: значение, затем ключ с дополнением (запись, прерванная сбросом, не пройдёт проверку).
+     */
+    static void writeRecord(uint32_t page, uint16_t slot, uint8_t key, uint16_t value)
+    {
+        uint32_t address = slotAddress(page, slot);
+        Flash::program(address, value), Flash::program(address + 2, key | (uint8_t)~key << 8);
+    }
+
+    /**
+     * @brief Проверяет, есть ли в странице записанные ячейки (стирание – самая долгая операция и изнашивает flash).
+     * @param page Адрес страницы.
+     */
+    static bool isUsed(uint32_t page)
+    {
+        for (uint32_t address = page; address < page + Flash::PAGE_SIZE; address += 2)
+            if (Flash::read(address) != 0xFFFF)
+                return true;
+        return false;
+    }
+
+    /**
+     * @brief Стирает страницу, если в ней есть записанные ячейки.
+     * @param page Адрес страницы.
+     */
+    void eraseIfUsed(uint32_t page)
+    {
+        if (isUsed(page))
+            Flash::erase(page), ++erases;
+    }
+
+    const uint32_t pages[2];        ///< Адреса страниц.
+    uint16_t values[KeyCount] = {}; ///< Копия значений в RAM.
+    volatile uint32_t present = 0;  ///< Маска заданных ключей.
+    volatile uint32_t dirty = 0;    ///< Маска ключей, ожидающих записи во flash.
+    uint8_t active = 0;             ///< Номер активной страницы.
+    uint16_t used = 0;              ///< Количество занятых записей активной страницы.
+    uint16_t generation = 0;        ///< Поколение активной страницы.
+    Step step = IDLE;               ///< Шаг отложенной работы.
+    uint8_t copyKey = 0;            ///< Уплотнение: следующий ключ для копирования.
+    uint16_t copySlot = 0;          ///< Уплотнение: количество скопированных записей.
+    uint32_t copied = 0;            ///< Уплотнение: ключи, значения которых скопированы и с тех пор не менялись.
+    bool enabled = false;           ///< Страницы свободны от прошивки.
+    uint16_t erases = 0;            ///< Счётчик стираний.
+    uint16_t writes = 0;            ///< Счётчик записей.
+    uint32_t maxStallCycles = 0;    ///< Худшее время вызова service(), тактов.
+};
+
+#endif // FLASH_STORE_H
@@ -0,0 +1,54 @@
+#ifndef I2C_SECOND_ADDRESS_H
+#define I2C_SECOND_ADDRESS_H
+
+#include <Arduino.h>
+#include <Wire.h>
+
+/**
+ * @brief Второй собственный адрес I2C-слейва (регистр OAR2) поверх Wire.
+ *
+ * Модуль I2C отвечает на оба адреса, а Wire вызывает для них одни и те же обработчики: транзакция чтения,
+ * адресованная второму адресу, распознаётся в обработчике запроса по флагу DUALF. Флаг сбрасывается условием STOP,
+ * а обработчик приёма Wire вызывается после STOP, поэтому для записи адрес не определяется – команды, принимаемые
+ * по второму адресу, должны отличаться от команд основного адреса по содержимому.
+ */
+class I2cSecondAddress
+{
+public:
+    /**
+     * @brief Конструктор класса I2cSecondAddress.
+     * @param i2c Модуль I2C, на котором работает слейв (I2C1).
+     * @param address Второй 7-битный адрес.
+     */
+    I2cSecondAddress(I2C_TypeDef *i2c, uint8_t address) : i2c(i2c), address(address) {}
+
+    /**
+     * @brief Включает приём второго адреса. Вызывается после Wire.begin().
+     * @param handle Дескриптор HAL модуля I2C (Wire.getHandle()).
+     */
+    void begin(I2C_HandleTypeDef *handle)
+    {
+        // HAL передаёт в обработчик Wire только совпадения с OwnAddress1: второй адрес должен выглядеть для него так же
+        handle->Init.OwnAddress2 = handle->Init.OwnAddress1;
+        i2c->OAR2 = (address << 1) | I2C_OAR2_ENDUAL;
+    }
+
+    /**
+     * @brief Проверяет, что текущая транзакция чтения адресована второму адресу. Вызывается из обработчика запроса Wire.
+     * @return true, если ведущий обратился ко второму адресу.
+     */
+    bool isAddressed() const { return i2c->SR2 & I2C_SR2_DUALF; }
+
+    /**
+     * @brief Включает или отключает ответ на второй адрес (отключённый адрес не подтверждается, NACK).
+     * Может вызываться из обработчиков Wire.
+     * @param enabled true – адрес принимается.
+     */
+    void setEnabled(bool enabled) { i2c->OAR2 = enabled ? (address << 1) | I2C_OAR2_ENDUAL : address << 1; }
+
+private:
+    I2C_TypeDef *const i2c; ///< Модуль I2C слейва.
+    const uint8_t address;  ///< Второй 7-битный адрес.
+};
+
+#endif // I2C_SECOND_ADDRESS_H
@@ -0,0 +1,104 @@
+#ifndef I2C_TRACE_H
+#define I2C_TRACE_H
+
+#include <Arduino.h>
+
+/**
+ * @brief Результат транзакции в журнале I2cTrace; бит 7 – направление (1 – чтение ведущим).
+ */
+enum I2cTraceStatus : uint8_t
+{
+    TRACE_WRITE_QUEUED = 0x00,    ///< Команда поставлена в очередь.
+    TRACE_WRITE_SELECT = 0x01,    ///< Команда выбора чтения или подтверждения журнала событий выполнена в прерывании.
+    TRACE_WRITE_DROPPED = 0x02,   ///< Команда отброшена: очередь заполнена.
+    TRACE_WRITE_EMPTY = 0x03,     ///< Запись без данных.
+    TRACE_WRITE_MALFORMED = 0x04, ///< Команда отклонена: неизвестный код или неполные данные.
+    TRACE_BOOT = 0x40,            ///< Запуск прошивки; байт 0 – флаги причины сброса (RCC->CSR[31:24]).
+    TRACE_READ = 0x80,            ///< Чтение; байт 0 – выбранный ответ (ReadMode).
+    TRACE_READ_ALERT = 0x81,      ///< Чтение по адресу ответа на прерывание SMBus (без байтов).
+    TRACE_READ_SECOND = 0x82,     ///< Чтение по второму собственному адресу (без байтов).
+};
+
+/**
+ * @brief Журнал последних транзакций I2C в кольцевом буфере, переживающий тёплый сброс.
+ *
+ * Экземпляр размещается в секции .noinit (не обнуляется при запуске): begin() проверяет сигнатуру и сохраняет
+ * записи, оставшиеся от предыдущего запуска, либо очищает буфер при включении питания. Секция .noinit
+ * добавляется в скрипт компоновщика фрагментом tools/noinit.ld (окружение i2c_slave_keyboard_trace). Запись транзакции – копирование
+ * не более MAX_BYTES байтов и нескольких полей, поэтому время record() ограничено и не зависит от длины команды.
+ * Класс не имеет инициализаторов членов: конструктор не должен затирать буфер при запуске.
+ *
+ * @tparam Capacity Количество записей (степень двойки, не больше 256).
+ */
+template <uint16_t Capacity>
+class I2cTrace
+{
+    static_assert(Capacity && !(Capacity & (Capacity - 1)) && Capacity <= 256, "Ёмкость журнала – степень двойки до 256");
+
+public:
+    static const uint8_t MAX_BYTES = 8; ///< Наибольшее количество сохраняемых байтов транзакции.
+
+    /**
+     * @brief Запись журнала в том виде, в котором она передаётся по I2C.
+     */
+    struct Entry
+    {
+        uint32_t timeUs;          ///< Момент транзакции, micros().
+        uint16_t seq;             ///< Сквозной номер транзакции.
+        uint8_t status;           ///< Результат транзакции (I2cTraceStatus).
+        uint8_t length;           ///< Количество байтов транзакции (сохраняется не более MAX_BYTES).
+        uint8_t bytes[MAX_BYTES]; ///< Первые байты транзакции.
+    };
+
+    /**
+     * @brief Проверяет буфер после сброса и добавляет запись о запуске. Вызывается до Wire.begin().
+     * @param resetFlags Флаги причины сброса (RCC->CSR[31:24]), сброшенные после чтения (RMVF).
+     */
+    void begin(uint8_t resetFlags)
+    {
+        if (magic != MAGIC || (resetFlags & (RCC_CSR_PORRSTF >> 24)))
+        {
+            memset(entries, 0, sizeof entries);
+            head = 0, magic = MAGIC; // Включение питания: содержимое RAM не определено
+        }
+        record(TRACE_BOOT, &resetFlags, 1);
+    }
+
+    /**
+     * @brief Добавляет запись о транзакции. Вызывается из прерывания I2C.
+     * @param status Результат транзакции (I2cTraceStatus).
+     * @param bytes Байты транзакции.
+     * @param length Количество байтов.
+     */
+    void record(uint8_t status, const uint8_t *bytes, uint8_t length)
+    {
+        Entry &entry = entries[head % Capacity];
+        entry.timeUs = micros(), entry.seq = head++, entry.status = status, entry.length = length;
+        memcpy(entry.bytes, bytes, length < MAX_BYTES ? length : MAX_BYTES);
+    }
+
+    /**
+     * @brief Копирует запись журнала. Вызывается из прерывания I2C.
+     * @param back Номер записи от последней (0 – последняя).
+     * @param out Приёмник записи.
+     * @return false, если такой записи нет.
+     */
+    bool read(uint16_t back, Entry &out) const
+    {
+        if (back >= stored())
+            return false;
+        out = entries[(uint16_t)(head - 1 - back) % Capacity];
+        return true;
+    }
+
+    uint16_t count() const { return head; }                          ///< @brief Количество записанных транзакций (по модулю 65536, сохраняется при тёплом сбросе).
+    uint16_t stored() const { return min<uint16_t>(head, Capacity); } ///< @brief Количество доступных для чтения записей.
+
+private:
+    static const uint32_t MAGIC = 0x54524331; ///< Сигнатура инициализированного буфера ("TRC1").
+    uint32_t magic;                           ///< Сигнатура; после включения питания – произвольное значение.
+    uint16_t head;                            ///< Номер следующей записи.
+    Entry entries[Capacity];                  ///< Кольцевой буфер записей.
+};
+
+#endif // I2C_TRACE_H
@@ -0,0 +1,160 @@
+#ifndef KEY_MATRIX_H
+#define KEY_MATRIX_H
+
+#include <Arduino.h>
+#include <utility>
+#include "ButtonHandler.h"
+
+/**
+ * @brief Сканер матричной клавиатуры (строки × столбцы) по прерыванию аппаратного таймера.
+ *
+ * Строки (выходы с открытым стоком) и столбцы (входы с подтяжкой) должны находиться на одном порту GPIO.
+ * За один шаг сканирования считываются столбцы выбранной на предыдущем шаге строки (одно чтение IDR)
+ * и выбирается следующая строка (одна запись BSRR), поэтому на установление уровней отводится целый
+ * период шага. Полный кадр собирается за Rows шагов, проверяется на фантомные нажатия и публикуется
+ * для основного цикла, где каждая клавиша обрабатывается собственным ButtonHandler.
+ *
+ * Без диодов одновременное нажатие трёх клавиш в углах прямоугольника даёт фантомное нажатие четвёртой.
+ * Такие прямоугольники обнаруживаются, и новые нажатия в них не принимаются, пока неоднозначность
+ * не исчезнет (уже нажатые клавиши сохраняются). С диодами фильтр отключается, и допускается
+ * одновременное нажатие любого количества клавиш (n-key rollover).
+ *
+ * Время сканирования (STM32F103, 72 МГц): шаг – около 40 тактов собственного кода и ~100 тактов
+ * входа в прерывание HardwareTimer, т.е. ~2 мкс. Полный кадр 4x4 занимает 4 шага (~8 мкс процессорного
+ * времени), 6x4 – 6 шагов (~12 мкс). Период шага не может быть меньше времени установления столбца:
+ * по модели test/test_key_matrix.cpp (подтяжка 50 кОм, столбец 50 пФ) это ~2.3 мкс, что даёт предел
+ * ~110 кГц кадров для 4x4 и ~74 кГц для 6x4 при полной загрузке процессора и ~25 кГц и ~17 кГц, если
+ * на сканирование отводится 20 % процессорного времени. При частоте кадров 1 кГц сканирование занимает
+ * менее 1.5 % процессорного времени. Измеренное на устройстве худшее время шага возвращает maxStepCycles().
+ *
+ * @tparam Rows Количество строк (выходов).
+ * @tparam Cols Количество столбцов (входов).
+ */
+template <uint8_t Rows, uint8_t Cols>
+class KeyMatrix
+{
+    static_assert(Rows * Cols <= 32, "Состояние матрицы хранится в 32-битной маске");
+
+public:
+    static const uint8_t KEY_COUNT = Rows * Cols; ///< Количество клавиш; клавиша (r, c) имеет индекс r * Cols + c.
+
+    /**
+     * @brief Конструктор класса KeyMatrix.
+     * @param rowPins Пины строк (Rows элементов).
+     * @param colPins Пины столбцов (Cols элементов), на том же порту, что и строки.
+     * @param debounceDelay Задержка для устранения дребезга в микросекундах.
+     * @param longPressThreshold Порог длительного нажатия в микросекундах.
+     * @param diodes true, если у клавиш установлены развязывающие диоды (фильтр фантомов не нужен).
+     */
+    KeyMatrix(const uint8_t *rowPins, const uint8_t *colPins, uint32_t debounceDelay, uint32_t longPressThreshold, bool diodes)
+        : KeyMatrix(rowPins, colPins, debounceDelay, longPressThreshold, diodes, std::make_index_sequence<KEY_COUNT>()) {}
+
+    /**
+     * @brief Настраивает пины и запускает сканирование.
+     * @param instance Таймер, прерывание которого выполняет шаги сканирования.
+     * @param frameRate Частота полных кадров в герцах.
+     */
+    void begin(TIM_TypeDef *instance, uint32_t frameRate)
+    {
+        uint32_t allRows = 0;
+        port = digitalPinToPort(rowPins[0]);
+        for (uint8_t r = 0; r < Rows; ++r)
+            pinMode(rowPins[r], OUTPUT_OPEN_DRAIN), allRows |= digitalPinToBitMask(rowPins[r]);
+        for (uint8_t c = 0; c < Cols; ++c)
+            pinMode(colPins[c], INPUT_PULLUP), colMask[c] = digitalPinToBitMask(colPins[c]);
+        for (uint8_t r = 0; r < Rows; ++r) // Выбранная строка – низкий уровень, остальные отпущены
+            rowSelect[r] = (allRows & ~digitalPinToBitMask(rowPins[r])) | (digitalPinToBitMask(rowPins[r]) << 16);
+        port->BSRR = rowSelect[0];
+
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk; // Счётчик тактов для измерения времени шага
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+        timer = new HardwareTimer(instance);
+        timer->setOverflow(frameRate * Rows, HERTZ_FORMAT);
+        timer->attachInterrupt([this] { scanStep(); });
+        timer->resume();
+    }
+
+    /**
+     * @brief Передаёт последний кадр обработчикам клавиш.
+     * @param ticks Текущее время в микросекундах.
+     */
+    void updateState(uint64_t ticks)
+    {
+        uint32_t pressed = frame;
+        for (uint8_t i = 0; i < KEY_COUNT; ++i)
+            keys[i].updateState(!((pressed >> i) & 1), ticks);
+    }
+
+    ButtonHandler &key(uint8_t index) { return keys[index]; } ///< @brief Обработчик клавиши. @param index Индекс клавиши. @return Ссылка на ButtonHandler.
+    uint32_t state() const { return frame; }                  ///< @brief Последний кадр после фильтра фантомов. @return Маска нажатых клавиш (до устранения дребезга).
+    uint32_t frameCount() const { return frames; }            ///< @brief Количество отсканированных кадров. @return Счётчик кадров.
+    uint32_t ghostFrameCount() const { return ghostFrames; }  ///< @brief Количество кадров с неоднозначными (фантомными) нажатиями. @return Счётчик кадров.
+    uint32_t maxStepCycles() const { return maxCycles; }      ///< @brief Худшее время шага сканирования. @return Время в тактах процессора.
+
+private:
+    template <size_t... I>
+    KeyMatrix(const uint8_t *rowPins, const uint8_t *colPins, uint32_t debounceDelay, uint32_t longPressThreshold, bool diodes, std::index_sequence<I...>)
+        : rowPins(rowPins), colPins(colPins), diodes(diodes),
+          keys{((void)I, ButtonHandler(ButtonHandler::NO_PIN, debounceDelay, longPressThreshold))...} {}
+
+    /**
+     * @brief Шаг сканирования: чтение столбцов выбранной строки и выбор следующей. Вызывается из прерывания таймера.
+     */
+    void scanStep()
+    {
+        uint32_t start = DWT->CYCCNT;
+        uint32_t idr = ~port->IDR; // Нажатая клавиша замыкает столбец на выбранную строку (низкий уровень)
+        uint32_t row = 0;
+        for (uint8_t c = 0; c < Cols; ++c)
+            row |= ((idr & colMask[c]) ? 1UL : 0UL) << c;
+        scanning |= row << (currentRow * Cols);
+        if (++currentRow == Rows)
+        {
+            frame = filterGhosts(scanning);
+            ++frames, scanning = 0, currentRow = 0;
+        }
+        port->BSRR = rowSelect[currentRow];
+        uint32_t cycles = DWT->CYCCNT - start;
+        if (cycles > maxCycles)
+            maxCycles = cycles;
+    }
+
+    /**
+     * @brief Отбрасывает новые нажатия в прямоугольниках, где возможно фантомное нажатие.
+     * @param raw Отсканированный кадр.
+     * @return Кадр, в котором неоднозначные клавиши сохраняют прежнее состояние нажатия.
+     */
+    uint32_t filterGhosts(uint32_t raw)
+    {
+        if (diodes)
+            return raw;
+        const uint32_t rowMask = (1UL << Cols) - 1;
+        uint32_t ambiguous = 0;
+        for (uint8_t r1 = 0; r1 < Rows; ++r1)
+            for (uint8_t r2 = r1 + 1; r2 < Rows; ++r2)
+            {
+                uint32_t common = (raw >> (r1 * Cols)) & (raw >> (r2 * Cols)) & rowMask;
+                if (common & (common - 1)) // Два и более общих столбца – прямоугольник из четырёх клавиш
+                    ambiguous |= (common << (r1 * Cols)) | (common << (r2 * Cols));
+            }
+        ghostFrames += (ambiguous != 0);
+        return (raw & ~ambiguous) | (raw & ambiguous & frame);
+    }
+
+    const uint8_t *const rowPins;      ///< Пины строк.
+    const uint8_t *const colPins;      ///< Пины столбцов.
+    const bool diodes;                 ///< Клавиши развязаны диодами.
+    ButtonHandler keys[KEY_COUNT];     ///< Обработчики клавиш (дребезг, короткое/длительное нажатие).
+    GPIO_TypeDef *port = nullptr;      ///< Порт GPIO строк и столбцов.
+    HardwareTimer *timer = nullptr;    ///< Таймер сканирования.
+    uint32_t colMask[Cols] = {};       ///< Маски столбцов в регистре IDR.
+    uint32_t rowSelect[Rows] = {};     ///< Значения BSRR для выбора каждой строки.
+    uint32_t scanning = 0;             ///< Собираемый кадр.
+    uint8_t currentRow = 0;            ///< Строка, выбранная на предыдущем шаге.
+    volatile uint32_t frame = 0;       ///< Последний полный кадр.
+    volatile uint32_t frames = 0;      ///< Счётчик кадров.
+    volatile uint32_t ghostFrames = 0; ///< Счётчик кадров с неоднозначными нажатиями.
+    volatile uint32_t maxCycles = 0;   ///< Худшее время шага в тактах.
+};
+
+#endif // KEY_MATRIX_H
@@ -0,0 +1,120 @@
+#ifndef LED_PATTERN_H
+#define LED_PATTERN_H
+
+#include <Arduino.h>
+
+/**
+ * @brief Воспроизведение последовательности масок светодиодов через DMA без участия процессора.
+ *
+ * Каждый кадр хранится как готовое значение регистра BSRR порта светодиодов (биты установки и сброса),
+ * и событие обновления таймера запускает передачу DMA очередного кадра в BSRR. Канал DMA работает
+ * в кольцевом режиме, поэтому шаблон повторяется бесконечно. Шаблоны хранятся в двух буферах:
+ * загрузка идёт в неактивный буфер, а запуск переключает воспроизведение на него целиком, поэтому
+ * кадры старого и нового шаблонов не смешиваются. Пины светодиодов должны находиться на одном порту.
+ * Таймер считает с частотой 10 кГц (тактирование таймера – SystemCoreClock), период кадра – 1..6553 мс.
+ */
+class LedPattern
+{
+public:
+    static const uint8_t MAX_FRAMES = 29; ///< Максимальное количество кадров (ограничено буфером Wire: команда и период занимают 3 байта).
+
+    /**
+     * @brief Конструктор класса LedPattern.
+     * @param timer Таймер, событие обновления которого задаёт период кадра.
+     * @param channel Канал DMA, связанный с запросом обновления таймера (например, DMA1_Channel7 для TIM4).
+     * @param pins Пины светодиодов (бит i маски кадра – pins[i]), до 8.
+     * @param pinCount Количество пинов.
+     */
+    LedPattern(TIM_TypeDef *timer, DMA_Channel_TypeDef *channel, const uint8_t *pins, uint8_t pinCount)
+        : timer(timer), channel(channel), pins(pins), pinCount(pinCount) {}
+
+    /**
+     * @brief Настраивает пины светодиодов, таймер и канал DMA (воспроизведение остановлено).
+     */
+    void begin()
+    {
+        port = digitalPinToPort(pins[0]);
+        for (uint8_t i = 0; i < pinCount; ++i)
+            pinMode(pins[i], OUTPUT), pinMasks[i] = digitalPinToBitMask(pins[i]);
+        RCC->AHBENR |= RCC_AHBENR_DMA1EN;
+        if (timer == TIM1)
+            RCC->APB2ENR |= RCC_APB2ENR_TIM1EN;
+        else
+            RCC->APB1ENR |= (timer == TIM2) ? RCC_APB1ENR_TIM2EN : (timer == TIM3) ? RCC_APB1ENR_TIM3EN : RCC_APB1ENR_TIM4EN;
+
+        timer->CR1 = 0;
+        timer->PSC = SystemCoreClock / 10000 - 1; // 10 кГц
+        timer->DIER = TIM_DIER_UDE;              // Запрос DMA по событию обновления
+        channel->CCR = 0;
+        channel->CPAR = (uint32_t)&port->BSRR;
+    }
+
+    /**
+     * @brief Загружает шаблон в неактивный буфер. Воспроизведение не меняется до вызова start().
+     * @param masks Маски светодиодов по кадрам.
+     * @param count Количество кадров (1..MAX_FRAMES).
+     * @param periodMs Период кадра в миллисекундах (1..6553).
+     * @return false, если параметры шаблона недопустимы.
+     */
+    bool load(const uint8_t *masks, uint8_t count, uint16_t periodMs)
+    {
+        if (!count || count > MAX_FRAMES || !periodMs || periodMs > 6553)
+            return false;
+        uint8_t back = active ^ 1;
+        for (uint8_t f = 0; f < count; ++f)
+        {
+            uint32_t set = 0, all = 0;
+            for (uint8_t i = 0; i < pinCount; ++i)
+                set |= (masks[f] & (1 << i)) ? pinMasks[i] : 0, all |= pinMasks[i];
+            frames[back][f] = set | ((all & ~set) << 16); // BSRR: младшие 16 бит – установка, старшие – сброс
+        }
+        counts[back] = count, periods[back] = periodMs;
+        return true;
+    }
+
+    /**
+     * @brief Запускает воспроизведение последнего загруженного шаблона (или переключает на него с начала).
+     * @return false, если шаблон ещё не загружался.
+     */
+    bool start()
+    {
+        uint8_t back = active ^ 1;
+        if (!counts[back])
+            return false;
+        stop();
+        active = back;
+        channel->CMAR = (uint32_t)frames[active];
+        channel->CNDTR = counts[active];
+        channel->CCR = DMA_CCR_MINC | DMA_CCR_CIRC | DMA_CCR_DIR | DMA_CCR_PSIZE_1 | DMA_CCR_MSIZE_1 | DMA_CCR_EN;
+        timer->ARR = periods[active] * 10 - 1;
+        timer->EGR = TIM_EGR_UG; // Первый кадр выводится сразу, отсчёт периода начинается заново
+        timer->CR1 = TIM_CR1_CEN;
+        counts[active ^ 1] = 0; // Прежний шаблон нужно загрузить заново
+        return true;
+    }
+
+    /**
+     * @brief Останавливает воспроизведение. Светодиоды сохраняют состояние последнего кадра.
+     */
+    void stop()
+    {
+        timer->CR1 = 0;
+        channel->CCR &= ~DMA_CCR_EN;
+    }
+
+    bool isPlaying() const { return channel->CCR & DMA_CCR_EN; } ///< @brief Проверяет, идёт ли воспроизведение. @return true, если канал DMA включён.
+
+private:
+    TIM_TypeDef *const timer;              ///< Таймер кадров.
+    DMA_Channel_TypeDef *const channel;    ///< Канал DMA.
+    const uint8_t *const pins;             ///< Пины светодиодов.
+    const uint8_t pinCount;                ///< Количество пинов.
+    GPIO_TypeDef *port = nullptr;          ///< Порт светодиодов.
+    uint32_t pinMasks[8] = {};             ///< Маски пинов в регистрах порта.
+    uint32_t frames[2][MAX_FRAMES] = {};   ///< Буферы шаблонов (значения BSRR).
+    uint8_t counts[2] = {};                ///< Количество кадров в буферах (0 – буфер не загружен).
+    uint16_t periods[2] = {};              ///< Периоды кадров буферов, мс.
+    uint8_t active = 0;                    ///< Индекс воспроизводимого буфера.
+};
+
+#endif // LED_PATTERN_H
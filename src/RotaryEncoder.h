@@ -0,0 +1,75 @@
+#ifndef ROTARY_ENCODER_H
+#define ROTARY_ENCODER_H
+
+#include <Arduino.h>
+
+/**
+ * @brief Класс для чтения квадратурного энкодера таймером STM32 в режиме энкодера.
+ *
+ * Таймер считает оба фронта обоих каналов (режим 3) с цифровым входным фильтром, поэтому подсчёт
+ * импульсов не требует процессорного времени и прерываний. Пины энкодера должны быть каналами 1 и 2
+ * выбранного таймера (например, PA8/PA9 для TIM1).
+ * Приращение читается в щелчках (detent) с накоплением: неполные щелчки и значения, не поместившиеся
+ * в один ответ, переносятся на следующее чтение, поэтому щелчки не теряются при редком опросе.
+ */
+class RotaryEncoder
+{
+public:
+    /**
+     * @brief Конструктор класса RotaryEncoder.
+     * @param timer Таймер, каналы 1 и 2 которого подключены к энкодеру.
+     * @param pinA Пин канала A (канал 1 таймера).
+     * @param pinB Пин канала B (канал 2 таймера).
+     * @param countsPerDetent Количество отсчётов таймера на один щелчок (4 для полного периода квадратуры).
+     * @param filter Код цифрового входного фильтра таймера (0–15, ICxF).
+     */
+    RotaryEncoder(TIM_TypeDef *timer, uint8_t pinA, uint8_t pinB, uint8_t countsPerDetent = 4, uint8_t filter = 0x0F)
+        : timer(timer), pinA(pinA), pinB(pinB), countsPerDetent(countsPerDetent), filter(filter) {}
+
+    /**
+     * @brief Настраивает пины и запускает таймер в режиме энкодера.
+     */
+    void begin()
+    {
+        pinMode(pinA, INPUT_PULLUP), pinMode(pinB, INPUT_PULLUP);
+        if (timer == TIM1)
+            RCC->APB2ENR |= RCC_APB2ENR_TIM1EN;
+        else
+            RCC->APB1ENR |= (timer == TIM2) ? RCC_APB1ENR_TIM2EN : (timer == TIM3) ? RCC_APB1ENR_TIM3EN : RCC_APB1ENR_TIM4EN;
+
+        timer->CR1 = 0;
+        timer->SMCR = TIM_SMCR_SMS_0 | TIM_SMCR_SMS_1; // Режим энкодера 3: счёт по фронтам TI1 и TI2
+        timer->CCMR1 = TIM_CCMR1_CC1S_0 | TIM_CCMR1_CC2S_0 | (filter << TIM_CCMR1_IC1F_Pos) | (filter << TIM_CCMR1_IC2F_Pos);
+        timer->CCER = 0;
+        timer->ARR = 0xFFFF;
+        timer->CNT = 0;
+        timer->CR1 = TIM_CR1_CEN;
+        reported = 0;
+    }
+
+    int16_t count() const { return (int16_t)timer->CNT; } ///< @brief Текущее значение счётчика. @return Отсчёты таймера (по модулю 2^16).
+
+    /**
+     * @brief Возвращает количество щелчков с момента предыдущего вызова.
+     * Остаток неполного щелчка и значения за пределами [-127, 127] переносятся на следующий вызов.
+     * Должна вызываться из одного контекста (например, только из обработчика запроса I2C).
+     * @return Приращение в щелчках (положительное – по часовой стрелке, если канал A опережает B).
+     */
+    int8_t takeDetents()
+    {
+        int16_t counts = (int16_t)((uint16_t)timer->CNT - reported);
+        int16_t detents = constrain(counts / countsPerDetent, -127, 127);
+        reported += detents * countsPerDetent;
+        return detents;
+    }
+
+private:
+    TIM_TypeDef *const timer;      ///< Таймер в режиме энкодера.
+    const uint8_t pinA;            ///< Пин канала A.
+    const uint8_t pinB;            ///< Пин канала B.
+    const uint8_t countsPerDetent; ///< Отсчётов на щелчок.
+    const uint8_t filter;          ///< Код входного фильтра.
+    uint16_t reported = 0;         ///< Значение счётчика, соответствующее уже переданным щелчкам.
+};
+
+#endif // ROTARY_ENCODER_H
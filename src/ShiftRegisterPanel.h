@@ -0,0 +1,147 @@
+#ifndef SHIFT_REGISTER_PANEL_H
+#define SHIFT_REGISTER_PANEL_H
+
+#include <Arduino.h>
+#include <utility>
+#include "ButtonHandler.h"
+
+/**
+ * @brief Панель расширения на сдвиговых регистрах: выходы на цепочке 74HC595, клавиши на цепочке 74HC165.
+ *
+ * Обе цепочки подключены к одному аппаратному SPI (SCK – общий тактовый сигнал, MOSI – вход первого 74HC595,
+ * MISO – выход первого 74HC165) и одному пину защёлки (RCLK 74HC595 и SH/LD 74HC165). Обновление панели:
+ * импульс защёлки загружает входы 74HC165 и выводит на 74HC595 данные предыдущей передачи, затем DMA
+ * выполняет полнодуплексную передачу Bytes байт (выходы уходят, входы приходят) без участия процессора.
+ * При SPI2 (fPCLK1 / 8 = 4.5 МГц) передача 4 байт (32 выхода и 32 клавиши) занимает ~7 мкс. Выходы появляются на
+ * следующем обновлении (задержка – один период обновления).
+ *
+ * Бит b байта i выходов – выход Qb i-го от микроконтроллера 74HC595; бит b байта i входов – вход Db i-го
+ * 74HC165. Клавиши (замыкают вход на землю) фильтруются банком вертикальных счётчиков (4 обновления)
+ * и обрабатываются ButtonHandler с PassThroughDebounce, как клавиши KeyMatrix.
+ *
+ * Выходы панели не связаны с состоянием светодиодов ledState: слейв задаёт их отдельной командой (0x4B).
+ *
+ * @tparam Bytes Количество регистров в каждой цепочке (до 4: состояние клавиш передаётся 32-битной маской).
+ */
+template <uint8_t Bytes>
+class ShiftRegisterPanel
+{
+    static_assert(Bytes >= 1 && Bytes <= 4, "Состояние клавиш хранится в 32-битной маске");
+
+public:
+    static const uint8_t KEY_COUNT = Bytes * 8;                            ///< Количество клавиш (и выходов).
+    typedef BasicButtonHandler<ButtonConfig, PassThroughDebounce> KeyHandler; ///< Обработчик клавиши.
+
+    /**
+     * @brief Конструктор класса ShiftRegisterPanel.
+     * @param spi Аппаратный SPI (например, SPI2).
+     * @param rxChannel Канал DMA приёма SPI (DMA1_Channel4 для SPI2).
+     * @param txChannel Канал DMA передачи SPI (DMA1_Channel5 для SPI2).
+     * @param sckPin Пин SCK.
+     * @param misoPin Пин MISO.
+     * @param mosiPin Пин MOSI.
+     * @param latchPin Пин защёлки.
+     * @param longPressThreshold Порог длительного нажатия клавиш в микросекундах.
+     */
+    ShiftRegisterPanel(SPI_TypeDef *spi, DMA_Channel_TypeDef *rxChannel, DMA_Channel_TypeDef *txChannel,
+                       uint8_t sckPin, uint8_t misoPin, uint8_t mosiPin, uint8_t latchPin, uint32_t longPressThreshold)
+        : ShiftRegisterPanel(spi, rxChannel, txChannel, sckPin, misoPin, mosiPin, latchPin, longPressThreshold,
+                             std::make_index_sequence<KEY_COUNT>()) {}
+
+    /**
+     * @brief Настраивает пины, SPI и каналы DMA.
+     */
+    void begin()
+    {
+        setAlternateOutput(sckPin), setAlternateOutput(mosiPin);
+        pinMode(misoPin, INPUT_PULLUP), pinMode(latchPin, OUTPUT), digitalWrite(latchPin, HIGH);
+        latchPort = digitalPinToPort(latchPin), latchMask = digitalPinToBitMask(latchPin);
+        RCC->AHBENR |= RCC_AHBENR_DMA1EN;
+        if (spi == SPI1)
+            RCC->APB2ENR |= RCC_APB2ENR_SPI1EN;
+        else
+            RCC->APB1ENR |= RCC_APB1ENR_SPI2EN;
+        spi->CR1 = SPI_CR1_MSTR | SPI_CR1_SSM | SPI_CR1_SSI | (2 << SPI_CR1_BR_Pos) | SPI_CR1_SPE; // Режим 0, fPCLK / 8
+        spi->CR2 = SPI_CR2_RXDMAEN | SPI_CR2_TXDMAEN;
+        rxChannel->CPAR = txChannel->CPAR = (uintptr_t)&spi->DR;
+        rxChannel->CMAR = (uintptr_t)rxBuffer, txChannel->CMAR = (uintptr_t)txBuffer;
+    }
+
+    /**
+     * @brief Обновляет панель: принимает входы завершённой передачи, выдаёт импульс защёлки и запускает следующую передачу.
+     * Вызывается периодически из основного цикла (задачи планировщика).
+     * @return false, если предыдущая передача ещё не завершена (обновление пропущено).
+     */
+    bool refresh()
+    {
+        if (busy && rxChannel->CNDTR)
+            return false;
+        if (busy)
+        {
+            uint32_t raw = 0;
+            for (uint8_t i = 0; i < Bytes; ++i)
+                raw |= (uint32_t)rxBuffer[i] << (8 * i);
+            levels = keyBank.update(raw);
+        }
+        latchPort->BSRR = latchMask << 16; // SH/LD = 0: 74HC165 загружает входы
+        latchPort->BSRR = latchMask;       // Фронт RCLK: 74HC595 выводит данные предыдущей передачи
+        for (uint8_t i = 0; i < Bytes; ++i)
+            txBuffer[i] = outputs[Bytes - 1 - i]; // Первым уходит байт дальнего регистра
+        rxChannel->CCR = txChannel->CCR = 0;
+        rxChannel->CNDTR = txChannel->CNDTR = Bytes;
+        rxChannel->CCR = DMA_CCR_MINC | DMA_CCR_EN;               // SPI -> память
+        txChannel->CCR = DMA_CCR_MINC | DMA_CCR_DIR | DMA_CCR_EN; // Память -> SPI, передача начинается
+        busy = true;
+        return true;
+    }
+
+    /**
+     * @brief Обрабатывает отфильтрованные уровни клавиш. Вызывается из основного цикла после refresh().
+     * @param ticks Текущее время в микросекундах.
+     */
+    void updateState(uint64_t ticks)
+    {
+        for (uint8_t i = 0; i < KEY_COUNT; ++i)
+            keys[i].updateState((levels >> i) & 1 ? true : false, ticks);
+    }
+
+    void setOutputs(uint8_t index, uint8_t value) { outputs[index] = value; } ///< @brief Задаёт байт выходов (из того же контекста, что и refresh(): задачи основного цикла). @param index Номер регистра (0 – ближний). @param value Состояние выходов Q0..Q7.
+    KeyHandler &key(uint8_t index) { return keys[index]; }                    ///< @brief Обработчик клавиши. @param index Индекс клавиши. @return Ссылка на обработчик.
+
+private:
+    template <size_t... I>
+    ShiftRegisterPanel(SPI_TypeDef *spi, DMA_Channel_TypeDef *rxChannel, DMA_Channel_TypeDef *txChannel, uint8_t sckPin,
+                       uint8_t misoPin, uint8_t mosiPin, uint8_t latchPin, uint32_t longPressThreshold, std::index_sequence<I...>)
+        : spi(spi), rxChannel(rxChannel), txChannel(txChannel), sckPin(sckPin), misoPin(misoPin), mosiPin(mosiPin), latchPin(latchPin),
+          keys{((void)I, KeyHandler(ButtonConfig::NO_PIN, 0, longPressThreshold))...} {}
+
+    /**
+     * @brief Переводит пин в режим выхода альтернативной функции (push-pull, 50 МГц).
+     */
+    static void setAlternateOutput(uint8_t pin)
+    {
+        GPIO_TypeDef *port = digitalPinToPort(pin);
+        uint8_t bit = __builtin_ctz(digitalPinToBitMask(pin));
+        volatile uint32_t &cr = bit < 8 ? port->CRL : port->CRH;
+        cr = (cr & ~(0xFUL << (bit % 8 * 4))) | (0xBUL << (bit % 8 * 4)); // CNF = 10, MODE = 11
+    }
+
+    SPI_TypeDef *const spi;                 ///< Аппаратный SPI.
+    DMA_Channel_TypeDef *const rxChannel;   ///< Канал DMA приёма.
+    DMA_Channel_TypeDef *const txChannel;   ///< Канал DMA передачи.
+    const uint8_t sckPin;                   ///< Пин SCK.
+    const uint8_t misoPin;                  ///< Пин MISO.
+    const uint8_t mosiPin;                  ///< Пин MOSI.
+    const uint8_t latchPin;                 ///< Пин защёлки.
+    KeyHandler keys[KEY_COUNT];             ///< Обработчики клавиш.
+    VerticalCounterBank keyBank;            ///< Устранение дребезга всех клавиш.
+    GPIO_TypeDef *latchPort = nullptr;      ///< Порт пина защёлки.
+    uint32_t latchMask = 0;                 ///< Маска пина защёлки.
+    uint32_t levels = 0xFFFFFFFF;           ///< Отфильтрованные уровни клавиш (1 – отпущена).
+    uint8_t outputs[Bytes] = {};            ///< Состояние выходов.
+    uint8_t txBuffer[Bytes] = {};           ///< Буфер передачи DMA.
+    uint8_t rxBuffer[Bytes] = {};           ///< Буфер приёма DMA.
+    bool busy = false;                      ///< Передача запущена (1 бит).
+};
+
+#endif // SHIFT_REGISTER_PANEL_H
@@ -0,0 +1,84 @@
+#ifndef SMBUS_ALERT_H
+#define SMBUS_ALERT_H
+
+#include <Arduino.h>
+#include <Wire.h>
+#include "I2cSecondAddress.h"
+
+/**
+ * @brief Сигнал SMBALERT# и ответ на адрес ответа на прерывание (ARA, 0x0C) для I2C-слейва.
+ *
+ * Несколько клавиатур подключают выходы SMBALERT# (открытый сток) к одной линии прерывания ведущего.
+ * Клавиатура с непрочитанными событиями удерживает линию в низком уровне; ведущий читает один байт по адресу 0x0C
+ * и получает адрес такой клавиатуры (биты [7:1]), после чего читает её события. Если на ARA отвечают несколько
+ * клавиатур одновременно, SDA – монтажное И их адресов: каждая передаёт свой адрес целиком, и ведущий читает
+ * побитовое И (например, 0x21 и 0x22 дают 0x20) – адрес другой клавиатуры или несуществующий. Поэтому клавиатура,
+ * ответившая на ARA, перестаёт отвечать на него (NACK), пока ведущий не прочитает её события (markServiced()),
+ * а ведущий, получивший адрес, который не подтверждается или не возвращает записей журнала, считает ответ
+ * коллизией и опрашивает все известные адреса по очереди. Линия SMBALERT# отпускается не по ответу на ARA,
+ * а когда события прочитаны.
+ *
+ * Адрес ARA принимается вторым собственным адресом (см. I2cSecondAddress).
+ */
+class SmbusAlert
+{
+public:
+    static const uint8_t ALERT_RESPONSE_ADDRESS = 0x0C; ///< Адрес ответа на прерывание SMBus.
+
+    /**
+     * @brief Конструктор класса SmbusAlert.
+     * @param i2c Модуль I2C, на котором работает слейв (I2C1).
+     * @param alertPin Пин сигнала SMBALERT# (открытый сток; для I2C1 – SMBA, PB5).
+     */
+    SmbusAlert(I2C_TypeDef *i2c, uint8_t alertPin) : alertResponse(i2c, ALERT_RESPONSE_ADDRESS), alertPin(alertPin) {}
+
+    /**
+     * @brief Включает приём адреса ARA и настраивает пин SMBALERT#. Вызывается после Wire.begin().
+     * @param handle Дескриптор HAL модуля I2C (Wire.getHandle()).
+     */
+    void begin(I2C_HandleTypeDef *handle)
+    {
+        pinMode(alertPin, OUTPUT_OPEN_DRAIN), digitalWrite(alertPin, HIGH);
+        alertResponse.begin(handle);
+    }
+
+    /**
+     * @brief Проверяет, что текущая транзакция адресована ARA. Вызывается из обработчика запроса Wire.
+     * @return true, если ведущий читает адрес ответа на прерывание.
+     */
+    bool isAlertResponse() const { return alertResponse.isAddressed(); }
+
+    /**
+     * @brief Передаёт ответ на чтение ARA: собственный адрес в битах [7:1]. До markServiced() адрес ARA не принимается.
+     * @param ownAddress Собственный 7-битный адрес слейва.
+     */
+    void respond(uint8_t ownAddress)
+    {
+        Wire.write(ownAddress << 1);
+        alertResponse.setEnabled(false);
+    }
+
+    /**
+     * @brief Снова включает ответ на ARA после чтения событий ведущим. Может вызываться из обработчиков Wire.
+     */
+    void markServiced() { alertResponse.setEnabled(true); }
+
+    /**
+     * @brief Устанавливает или снимает сигнал SMBALERT#.
+     * @param pending true, если у клавиатуры есть непрочитанные события.
+     */
+    void setPending(bool pending)
+    {
+        if (pending != asserted)
+            asserted = pending, digitalWrite(alertPin, pending ? LOW : HIGH);
+    }
+
+    bool isPending() const { return asserted; } ///< @brief Проверяет, установлен ли сигнал SMBALERT#. @return true, если линия удерживается в низком уровне.
+
+private:
+    I2cSecondAddress alertResponse; ///< Адрес ARA (второй собственный адрес слейва).
+    const uint8_t alertPin;         ///< Пин сигнала SMBALERT#.
+    volatile bool asserted = false; ///< Текущее состояние сигнала SMBALERT#.
+};
+
+#endif // SMBUS_ALERT_H
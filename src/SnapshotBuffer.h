@@ -0,0 +1,59 @@
+#ifndef SNAPSHOT_BUFFER_H
+#define SNAPSHOT_BUFFER_H
+
+#include <Arduino.h>
+
+/**
+ * @brief Двойной буфер для передачи согласованного снимка состояния из основного цикла в прерывание.
+ *
+ * Писатель (основной цикл) заполняет неактивную половину буфера и публикует её одной записью индекса,
+ * поэтому читатель (обработчик прерывания) всегда получает полностью сформированный снимок.
+ * Каждая публикация увеличивает счётчик последовательности, по которому читатель проверяет,
+ * что снимок не был перезаписан во время копирования.
+ *
+ * @tparam T Тип снимка (тривиально копируемая структура).
+ */
+template <typename T>
+class SnapshotBuffer
+{
+public:
+    /**
+     * @brief Публикует новый снимок. Вызывается только из одного контекста (писателя).
+     * @param value Новое состояние.
+     */
+    void publish(const T &value)
+    {
+        uint8_t next = front ^ 1;
+        buffers[next] = value;
+        sequences[next] = sequences[front] + 1;
+        __DMB(); // Снимок должен быть записан до переключения индекса
+        front = next;
+    }
+
+    /**
+     * @brief Копирует последний опубликованный снимок. Безопасно вызывать из прерывания.
+     * @param out Приёмник копии снимка.
+     * @return Номер последовательности скопированного снимка.
+     */
+    uint8_t read(T &out) const
+    {
+        uint8_t index, sequence;
+        do
+        {
+            index = front;
+            sequence = sequences[index];
+            out = buffers[index];
+            __DMB();
+        } while (index != front || sequence != sequences[index]);
+        return sequence;
+    }
+
+    uint8_t sequence() const { return sequences[front]; } ///< @brief Номер последовательности последнего снимка.
+
+private:
+    T buffers[2] = {};                   ///< Две половины буфера.
+    volatile uint8_t sequences[2] = {};  ///< Номера последовательности каждой половины.
+    volatile uint8_t front = 0;          ///< Индекс опубликованной половины.
+};
+
+#endif // SNAPSHOT_BUFFER_H
@@ -3,41 +3,699 @@
 #include <Arduino.h>
 #include <Wire.h>
 
-#define SLAVE_ADDRESS 0x20 // Адрес ведомого устройства
-#define CMD_WRITE_LED 0x40 // Команда для записи состояния светодиодов
+#define SLAVE_ADDRESS 0x20             // Адрес ведомого устройства
+#define CMD_WRITE_LED 0x40             // Команда для записи состояния светодиодов
+#define CMD_READ_TIMING 0x42           // Команда чтения временных меток нажатий
+#define CMD_READ_GESTURES 0x43         // Команда чтения байта жестов (серий касаний)
+#define CMD_READ_MATRIX 0x44           // Команда чтения состояния матрицы клавиш (прошивка с KEY_MATRIX)
+#define CMD_READ_ENCODER 0x45          // Команда чтения состояния кнопок и приращения энкодера (прошивка с ROTARY_ENCODER)
+#define CMD_READ_SCHEDULER 0x46        // Команда чтения статистики планировщика
+#define CMD_READ_COROUTINES 0x47       // Команда чтения статистики сопрограмм (прошивка с COROUTINE_TASKS)
+#define CMD_READ_DEBOUNCE 0x48         // Команда чтения параметров адаптивного устранения дребезга
+#define CMD_LED_PATTERN 0x49           // Команда загрузки шаблона светодиодов (прошивка с LED_PATTERN)
+#define CMD_LED_PLAYBACK 0x4A          // Команда запуска (1) и остановки (0) воспроизведения шаблона
+#define CMD_WRITE_EXPANDER 0x4B        // Команда записи выходов панели расширения (прошивка с SHIFT_EXPANDER)
+#define CMD_READ_EXPANDER 0x4C         // Команда чтения состояния клавиш панели расширения
+#define CMD_READ_EVENTS 0x4D           // Команда чтения журнала событий кнопок (с номером первой записи)
+#define CMD_ACK_EVENTS 0x4E            // Команда подтверждения записей журнала событий
+#define CMD_BROADCAST_LED 0x4F         // Команда записи светодиодов общим вызовом (адрес 0x00) – всем клавиатурам
+#define GENERAL_CALL_ADDRESS 0x00      // Адрес общего вызова I2C
+#define CMD_SUBSCRIBE 0x50             // Команда подписки на события (маска байта состояния, маска жестов, флаги)
+#define CMD_READ_LED 0x51              // Команда выбора регистра светодиодов для чтения (без изменения светодиодов)
+#define CMD_READ_QUEUE 0x52            // Команда чтения статистики очереди команд ведомого
+#define CMD_READ_TRACE 0x53            // Команда чтения записи журнала транзакций I2C (прошивка с I2C_TRACE)
+#define CMD_READ_HEALTH 0x54           // Команда чтения счётчиков работоспособности ведомого
+#define CMD_WRITE_SETTING 0x55         // Команда записи сохраняемой настройки (ключ, значение uint16_t)
+#define CMD_READ_SETTING 0x56          // Команда чтения сохраняемой настройки (ключ)
+#define CMD_READ_STORE 0x57            // Команда чтения статистики хранилища настроек ведомого
+#define TRACE_RECORD_SIZE 20           // Размер ответа журнала транзакций: заголовок (4 байта) и запись (16 байт)
+#define LED_ADDRESS 0x21               // Адрес светодиодов ведомого (прошивка с DUAL_ADDRESS)
+#define ALERT_RESPONSE_ADDRESS 0x0C    // Адрес ответа на прерывание SMBus (ARA)
+#define ALERT_PIN PB5                  // Вход линии SMBALERT# (к PB5 ведомых, прошивка с SMBUS_ALERT)
+#define POLL_PERIOD_MS 50              // Период циклического опроса ведомых (20 Гц, как в pollSlave)
+#define EVENTS_PER_READ 3              // Наибольшее количество записей журнала в одном ответе
+#define EVENT_ENTRY_SIZE 8             // Размер записи журнала: время (uint32_t), состояние, события, жесты, резерв
+#define PATTERN_MAX_FRAMES 29          // Максимальное количество кадров шаблона (буфер Wire – 32 байта)
+#define SLAVE_CPU_MHZ 72               // Тактовая частота ведомого, МГц (для пересчёта тактов в мкс)
+#define ENC_SIM_PIN_A PB12             // Выход имитатора энкодера, канал A (к PA8 ведомого)
+#define ENC_SIM_PIN_B PB13             // Выход имитатора энкодера, канал B (к PA9 ведомого)
+#define ENC_SIM_STEP_US 500            // Длительность одного состояния квадратурного сигнала имитатора, мкс
+#define TIMING_BLOCK_SIZE 28           // Размер ответа на команду чтения временных меток (7 x uint32_t)
+#define STRESS_DEFAULT_ITERATIONS 1000 // Количество итераций стресс-теста по умолчанию
+#define STRESS_LATENCY_BUCKETS 8       // Количество интервалов гистограммы задержек (степени двойки от 128 мкс)
+
+// Вывод байта состояния кнопок в монитор (только при изменении)
+void printButtonState(uint8_t data)
+{
+    static uint8_t lastButtonState = 0; // Храним предыдущее состояние кнопок
+    // Если состояние изменилось, выводим его в монитор
+    if (data != lastButtonState)
+    {
+        Serial.print("Value: 0b"), Serial.print(data, BIN), Serial.print("\t");
+
+        if ((data & 0x01) != (lastButtonState & 0x01))
+            Serial.println((data & 0x01) ? "Vol-: Кнопка нажата" : "Vol-: Кнопка отпущена");
+        if ((data & 0x02) != (lastButtonState & 0x02))
+            Serial.println("Vol-: Кратковременное нажатие");
+        if ((data & 0x04) != (lastButtonState & 0x04))
+            Serial.println("Vol-: Длительное нажатие");
+        if ((data & 0x08) != (lastButtonState & 0x08))
+            Serial.println((data & 0x08) ? "Vol+: Кнопка нажата" : "Vol+: Кнопка отпущена");
+        if ((data & 0x10) != (lastButtonState & 0x10))
+            Serial.println("Vol+: Кратковременное нажатие");
+        if ((data & 0x20) != (lastButtonState & 0x20))
+            Serial.println("Vol+: Длительное нажатие");
+        if (data & 0x40)
+            Serial.println("Vol- и Vol+: Одновременное нажатие");
+
+        lastButtonState = data;
+    }
+}
 
 // Функция опроса ведомого устройства для получения состояния кнопок
 void pollSlave()
 {
-    static uint8_t lastButtonState = 0; // Храним предыдущее состояние кнопок
     Wire.requestFrom(SLAVE_ADDRESS, 1); // Запрос 1 байта
     if (Wire.available())
     {
         uint8_t data = Wire.read();
         // Если установлен бит 7, то это состояние светодиодов, а не кнопок – пропускаем.
         if (!(data & 0x80))
+            printButtonState(data);
+    }
+}
+
+// Чтение и вывод временных меток последних нажатий кнопок
+void readTiming()
+{
+    uint32_t values[TIMING_BLOCK_SIZE / 4]; // Время устройства, затем начало/отпускание/длительность для Vol- и Vol+
+    Wire.beginTransmission(SLAVE_ADDRESS);
+    Wire.write(CMD_READ_TIMING);
+    if (Wire.endTransmission(false) != 0 || Wire.requestFrom(SLAVE_ADDRESS, TIMING_BLOCK_SIZE) != TIMING_BLOCK_SIZE)
+    {
+        Serial.println("Ошибка чтения временных меток");
+        return;
+    }
+    for (uint8_t i = 0; i < TIMING_BLOCK_SIZE; ++i)
+        ((uint8_t *)values)[i] = Wire.read(); // Данные передаются в little-endian, как и хранятся в STM32
+
+    Serial.print("Время устройства: "), Serial.print(values[0]), Serial.println(" мс");
+    const char *names[] = {"Vol-", "Vol+"};
+    for (uint8_t i = 0; i < 2; ++i)
+    {
+        Serial.print(names[i]), Serial.print(": нажатие "), Serial.print(values[1 + 3 * i]);
+        Serial.print(" мс, отпускание "), Serial.print(values[2 + 3 * i]);
+        Serial.print(" мс, длительность "), Serial.print(values[3 + 3 * i]), Serial.println(" мс");
+    }
+}
+
+// Чтение и вывод серий касаний, завершённых с момента предыдущего чтения жестов
+void readGestures()
+{
+    Wire.beginTransmission(SLAVE_ADDRESS);
+    Wire.write(CMD_READ_GESTURES);
+    if (Wire.endTransmission(false) != 0 || Wire.requestFrom(SLAVE_ADDRESS, 1) != 1)
+    {
+        Serial.println("Ошибка чтения жестов");
+        return;
+    }
+    uint8_t data = Wire.read();
+    Serial.print("Жесты: 0b"), Serial.println(data, BIN);
+    for (uint8_t bit = 0; bit < 6; ++bit)
+        if (data & (1 << bit))
+            Serial.print(bit < 3 ? "Vol-: " : "Vol+: "), Serial.print(bit % 3 + 1), Serial.println("-кратное касание");
+}
+
+// Загрузка и запуск шаблона светодиодов: "pattern <период, мс> <маска> <маска> ..." или остановка: "pattern stop"
+void sendPattern(const String &args)
+{
+    Wire.beginTransmission(SLAVE_ADDRESS);
+    if (args == "stop")
+    {
+        Wire.write(CMD_LED_PLAYBACK), Wire.write(0);
+        Serial.println(Wire.endTransmission() == 0 ? "Шаблон остановлен" : "Ошибка передачи по I2C");
+        return;
+    }
+    const char *cursor = args.c_str();
+    char *end;
+    uint16_t period = strtol(cursor, &end, 0);
+    uint8_t frames = 0;
+    Wire.write(CMD_LED_PATTERN), Wire.write(period & 0xFF), Wire.write(period >> 8);
+    for (cursor = end; frames < PATTERN_MAX_FRAMES; cursor = end, ++frames)
+    {
+        uint8_t mask = strtol(cursor, &end, 0);
+        if (end == cursor)
+            break;
+        Wire.write(mask);
+    }
+    if (Wire.endTransmission() != 0 || !frames)
+    {
+        Serial.println("Ошибка загрузки шаблона");
+        return;
+    }
+    Wire.beginTransmission(SLAVE_ADDRESS);
+    Wire.write(CMD_LED_PLAYBACK), Wire.write(1);
+    Serial.print(Wire.endTransmission() == 0 ? "Запущен шаблон, кадров: " : "Ошибка запуска шаблона, кадров: ");
+    Serial.println(frames);
+}
+
+// Чтение и вывод параметров адаптивного устранения дребезга: рабочая задержка, наблюдаемый дребезг, число наблюдений
+void readDebounce()
+{
+    uint8_t buffer[16];
+    Wire.beginTransmission(SLAVE_ADDRESS);
+    Wire.write(CMD_READ_DEBOUNCE);
+    if (Wire.endTransmission(false) != 0 || Wire.requestFrom(SLAVE_ADDRESS, sizeof buffer) != sizeof buffer)
+    {
+        Serial.println("Ошибка чтения параметров дребезга");
+        return;
+    }
+    for (uint8_t i = 0; i < sizeof buffer; ++i)
+        buffer[i] = Wire.read();
+    for (uint8_t button = 0; button < 2; ++button)
+    {
+        uint32_t effective;
+        uint16_t bounce, observations;
+        memcpy(&effective, buffer + 8 * button, sizeof effective);
+        memcpy(&bounce, buffer + 8 * button + 4, sizeof bounce), memcpy(&observations, buffer + 8 * button + 6, sizeof observations);
+        Serial.print(button ? "Vol+: задержка " : "Vol-: задержка "), Serial.print(effective / 1000.0, 1);
+        Serial.print(" мс, дребезг "), Serial.print(bounce / 1000.0, 1);
+        Serial.print(" мс, наблюдений "), Serial.println(observations);
+    }
+}
+
+// Чтение и вывод состояния группы клавиш (матрицы или панели расширения): маски нажатых клавиш, кратковременных и длительных нажатий
+void readKeyMasks(uint8_t command, const char *name)
+{
+    uint32_t masks[3];
+    Wire.beginTransmission(SLAVE_ADDRESS);
+    Wire.write(command);
+    if (Wire.endTransmission(false) != 0 || Wire.requestFrom(SLAVE_ADDRESS, sizeof masks) != sizeof masks)
+    {
+        Serial.print("Ошибка чтения: "), Serial.println(name);
+        return;
+    }
+    for (uint8_t i = 0; i < sizeof masks; ++i)
+        ((uint8_t *)masks)[i] = Wire.read();
+    Serial.print(name), Serial.print(": нажаты 0x"), Serial.print(masks[0], HEX);
+    Serial.print(", кратковременные 0x"), Serial.print(masks[1], HEX);
+    Serial.print(", длительные 0x"), Serial.println(masks[2], HEX);
+}
+
+// Чтение журнала событий кнопок до опустошения: "events [потери, %]".
+// Ответы отбрасываются с заданной вероятностью (имитация потерь на шине: NACK, сброс ведущего); потерянный ответ
+// запрашивается повторно с того же номера, поэтому записи должны приходить без пропусков и повторов.
+void readEvents(uint8_t lossPercent)
+{
+    static uint16_t nextSeq = 0;   // Номер следующей ожидаемой записи
+    static bool synced = false;    // Номер получен от ведомого (после запуска – с самой старой записи)
+    uint32_t reads = 0, lost = 0, received = 0, gaps = 0;
+    while (reads < 1000)
+    {
+        uint8_t buffer[4 + EVENTS_PER_READ * EVENT_ENTRY_SIZE];
+        Wire.beginTransmission(SLAVE_ADDRESS);
+        Wire.write(CMD_READ_EVENTS);
+        if (synced)
+            Wire.write(nextSeq & 0xFF), Wire.write(nextSeq >> 8); // Чтение с номера – повторяемое и конвейерное
+        if (Wire.endTransmission(false) != 0 || Wire.requestFrom(SLAVE_ADDRESS, sizeof buffer) < 4)
         {
-            // Если состояние изменилось, выводим его в монитор
-            if (data != lastButtonState)
-            {
-                Serial.print("Value: 0b"), Serial.print(data, BIN), Serial.print("\t");
-
-                if ((data & 0x01) != (lastButtonState & 0x01))
-                    Serial.println((data & 0x01) ? "Vol-: Кнопка нажата" : "Vol-: Кнопка отпущена");
-                if ((data & 0x02) != (lastButtonState & 0x02))
-                    Serial.println("Vol-: Кратковременное нажатие");
-                if ((data & 0x04) != (lastButtonState & 0x04))
-                    Serial.println("Vol-: Длительное нажатие");
-                if ((data & 0x08) != (lastButtonState & 0x08))
-                    Serial.println((data & 0x08) ? "Vol+: Кнопка нажата" : "Vol+: Кнопка отпущена");
-                if ((data & 0x10) != (lastButtonState & 0x10))
-                    Serial.println("Vol+: Кратковременное нажатие");
-                if ((data & 0x20) != (lastButtonState & 0x20))
-                    Serial.println("Vol+: Длительное нажатие");
-
-                lastButtonState = data;
-            }
+            Serial.println("Ошибка чтения журнала событий");
+            return;
+        }
+        uint8_t size = Wire.available();
+        for (uint8_t i = 0; i < size; ++i)
+            buffer[i] = Wire.read();
+        ++reads;
+        if ((uint8_t)random(100) < lossPercent)
+        {
+            ++lost; // Ответ "потерян" – повторяем чтение с того же номера
+            continue;
+        }
+        uint16_t first = buffer[0] | (buffer[1] << 8);
+        uint8_t count = min(buffer[2], (uint8_t)((size - 4) / EVENT_ENTRY_SIZE));
+        gaps += synced && count && first != nextSeq;
+        for (uint8_t i = 0; i < count; ++i)
+        {
+            const uint8_t *entry = buffer + 4 + i * EVENT_ENTRY_SIZE;
+            uint32_t timeMs;
+            memcpy(&timeMs, entry, sizeof timeMs);
+            Serial.print("#"), Serial.print((uint16_t)(first + i)), Serial.print(" "), Serial.print(timeMs);
+            Serial.print(" мс: состояние 0b"), Serial.print(entry[4] | entry[5], BIN);
+            Serial.print(", жесты 0b"), Serial.println(entry[6], BIN);
+        }
+        if (!count)
+            break;
+        received += count, nextSeq = first + count, synced = true;
+        if ((uint8_t)random(100) >= lossPercent) // Потерянное подтверждение покроет следующее: оно удаляет все записи до номера
+        {
+            Wire.beginTransmission(SLAVE_ADDRESS);
+            Wire.write(CMD_ACK_EVENTS), Wire.write((nextSeq - 1) & 0xFF), Wire.write((nextSeq - 1) >> 8);
+            Wire.endTransmission();
+        }
+    }
+    Serial.print("Журнал: чтений "), Serial.print(reads), Serial.print(", потеряно "), Serial.print(lost);
+    Serial.print(", записей "), Serial.print(received), Serial.print(", пропусков номеров "), Serial.println(gaps);
+}
+
+// Запись светодиодов всем клавиатурам одной транзакцией общего вызова: "broadcast <маска> [группы]"
+// (маска и группы – десятичные или шестнадцатеричные с "0x"). Выводится длительность транзакции на шине.
+void broadcastLeds(const String &args)
+{
+    char *end;
+    uint8_t leds = strtoul(args.c_str(), &end, 0) & 0x3F;
+    String groups = String(end);
+    groups.trim();
+    uint32_t t0 = micros();
+    Wire.beginTransmission(GENERAL_CALL_ADDRESS);
+    Wire.write(CMD_BROADCAST_LED), Wire.write(leds);
+    if (groups.length())
+        Wire.write((uint8_t)strtoul(groups.c_str(), NULL, 0));
+    uint8_t error = Wire.endTransmission();
+    uint32_t elapsed = micros() - t0;
+    Serial.print(error == 0 ? "Общий вызов LED: 0x" : "Ошибка общего вызова LED: 0x"), Serial.print(leds, HEX);
+    Serial.print(", "), Serial.print(elapsed), Serial.println(" мкс");
+}
+
+// Чтение и подтверждение журнала событий ведомого без вывода. Количество транзакций на шине добавляется к transactions.
+// Возвращает количество полученных записей.
+uint32_t drainEventLog(uint8_t address, uint32_t &transactions)
+{
+    uint32_t received = 0;
+    for (;;)
+    {
+        uint8_t buffer[4 + EVENTS_PER_READ * EVENT_ENTRY_SIZE];
+        Wire.beginTransmission(address);
+        Wire.write(CMD_READ_EVENTS);
+        transactions += 2; // Запись команды и чтение
+        if (Wire.endTransmission(false) != 0 || Wire.requestFrom(address, sizeof buffer) < 4)
+            return received;
+        uint8_t size = Wire.available();
+        for (uint8_t i = 0; i < size; ++i)
+            buffer[i] = Wire.read();
+        uint16_t last = (buffer[0] | (buffer[1] << 8)) + buffer[2] - 1;
+        if (!buffer[2])
+            return received;
+        Wire.beginTransmission(address);
+        Wire.write(CMD_ACK_EVENTS), Wire.write(last & 0xFF), Wire.write(last >> 8);
+        Wire.endTransmission();
+        ++transactions, received += buffer[2];
+    }
+}
+
+// Адреса ведомых на шине, опрашиваемые по очереди при коллизии ответов на ARA
+static const uint8_t KNOWN_SLAVES[] = {SLAVE_ADDRESS};
+
+// Сравнение опроса по SMBALERT# с циклическим опросом: "alert <с>" – по N секунд на каждый способ.
+// По сигналу ведущий читает ARA (адрес ведомого с событиями) и журнал этого ведомого; задержка – от обнаружения
+// низкого уровня SMBALERT# до получения записей. При одновременном ответе нескольких ведомых ARA возвращает побитовое И
+// их адресов: если ARA не подтверждается или по полученному адресу нет записей журнала, ответ считается коллизией
+// и журналы всех известных ведомых читаются по очереди. При циклическом опросе журнал читается каждые POLL_PERIOD_MS,
+// задержка события – до одного периода (в среднем половина).
+void comparePolling(uint32_t seconds)
+{
+    pinMode(ALERT_PIN, INPUT_PULLUP);
+    uint32_t transactions = 0, received = 0, alerts = 0, collisions = 0, maxLatency = 0;
+    uint64_t sumLatency = 0;
+    for (uint32_t start = millis(); millis() - start < seconds * 1000;)
+    {
+        if (digitalRead(ALERT_PIN) == HIGH)
+            continue;
+        uint32_t t0 = micros(), count = 0;
+        ++transactions;
+        if (Wire.requestFrom(ALERT_RESPONSE_ADDRESS, 1) == 1)
+            count = drainEventLog(Wire.read() >> 1, transactions);
+        if (!count) // Коллизия (или ответившие ведомые уже не отвечают на ARA) – опрос всех по очереди
+        {
+            ++collisions;
+            for (uint8_t address : KNOWN_SLAVES)
+                count += drainEventLog(address, transactions);
         }
+        uint32_t latency = micros() - t0;
+        received += count, ++alerts;
+        sumLatency += latency, maxLatency = max(maxLatency, latency);
+        delay(2); // Ведомый отпускает SMBALERT# в следующем тике планировщика
+    }
+    Serial.print("SMBALERT#: сигналов "), Serial.print(alerts), Serial.print(", коллизий "), Serial.print(collisions);
+    Serial.print(", записей "), Serial.print(received);
+    Serial.print(", транзакций/с "), Serial.print((float)transactions / seconds, 1);
+    Serial.print(", задержка avg "), Serial.print(alerts ? (uint32_t)(sumLatency / alerts) : 0);
+    Serial.print(" мкс, max "), Serial.print(maxLatency), Serial.println(" мкс");
+
+    transactions = received = 0;
+    for (uint32_t start = millis(); millis() - start < seconds * 1000; delay(POLL_PERIOD_MS))
+        received += drainEventLog(SLAVE_ADDRESS, transactions);
+    Serial.print("Циклический опрос: записей "), Serial.print(received);
+    Serial.print(", транзакций/с "), Serial.print((float)transactions / seconds, 1);
+    Serial.print(", задержка avg "), Serial.print(POLL_PERIOD_MS * 1000 / 2);
+    Serial.print(" мкс, max "), Serial.print(POLL_PERIOD_MS * 1000), Serial.println(" мкс (на каждого ведомого на шине)");
+}
+
+// Подписка на события: "subscribe <маска состояния> <маска жестов> [change]" (маски – десятичные или с "0x");
+// "change" включает режим "только изменения": SMBALERT# – лишь по подписанным событиям.
+void subscribe(const String &args)
+{
+    char *end;
+    uint8_t events = strtoul(args.c_str(), &end, 0), gestures = strtoul(end, &end, 0);
+    bool changeOnly = strstr(end, "change") != NULL;
+    Wire.beginTransmission(SLAVE_ADDRESS);
+    Wire.write(CMD_SUBSCRIBE), Wire.write(events), Wire.write(gestures), Wire.write(changeOnly ? 0x01 : 0x00);
+    Serial.print(Wire.endTransmission() == 0 ? "Подписка: состояние 0x" : "Ошибка подписки: состояние 0x");
+    Serial.print(events, HEX), Serial.print(", жесты 0x"), Serial.print(gestures, HEX);
+    Serial.println(changeOnly ? ", только изменения" : "");
+}
+
+// Чтение состояния светодиодов одной транзакцией: запись команды 0x51, повторный START и чтение
+void readLeds()
+{
+    Wire.beginTransmission(SLAVE_ADDRESS);
+    Wire.write(CMD_READ_LED);
+    if (Wire.endTransmission(false) != 0 || Wire.requestFrom(SLAVE_ADDRESS, 1) != 1)
+    {
+        Serial.println("Ошибка чтения светодиодов");
+        return;
+    }
+    Serial.print("Светодиоды: 0x"), Serial.println(Wire.read() & 0x3F, HEX);
+}
+
+// Запись и чтение светодиодов по адресу светодиодов без байта команды: "dual <маска>"; для сравнения выполняется
+// тот же цикл по основному адресу (0x40 с битом 7 и чтение). Выводится длительность обоих циклов на шине.
+void dualAddressLeds(uint8_t leds)
+{
+    leds &= 0x3F;
+    uint32_t t0 = micros();
+    Wire.beginTransmission(LED_ADDRESS);
+    Wire.write(leds);
+    bool ok = Wire.endTransmission(false) == 0 && Wire.requestFrom(LED_ADDRESS, 1) == 1 && Wire.read() == leds;
+    uint32_t t1 = micros();
+    Wire.beginTransmission(SLAVE_ADDRESS);
+    Wire.write(CMD_WRITE_LED), Wire.write(leds | 0x80);
+    bool legacyOk = Wire.endTransmission(false) == 0 && Wire.requestFrom(SLAVE_ADDRESS, 1) == 1 && Wire.read() == (leds | 0x80);
+    uint32_t t2 = micros();
+    Serial.print("Адрес светодиодов: "), Serial.print(ok ? "OK, " : "ОШИБКА, "), Serial.print(t1 - t0);
+    Serial.print(" мкс; основной адрес: "), Serial.print(legacyOk ? "OK, " : "ОШИБКА, "), Serial.print(t2 - t1);
+    Serial.println(" мкс");
+}
+
+// Чтение статистики ведомого в буфер (команды 0x46 и 0x47 действуют на одно чтение)
+bool requestStats(uint8_t command, uint8_t *buffer, uint8_t size)
+{
+    Wire.beginTransmission(SLAVE_ADDRESS);
+    Wire.write(command);
+    if (Wire.endTransmission(false) != 0 || Wire.requestFrom(SLAVE_ADDRESS, size) != size)
+        return false;
+    for (uint8_t i = 0; i < size; ++i)
+        buffer[i] = Wire.read();
+    return true;
+}
+
+// Вывод времени выполнения задач (по 8 байт на задачу: худшее и среднее время в тактах)
+void printTaskCycles(const uint8_t *tasks, uint8_t count)
+{
+    for (uint8_t task = 0; task < count; ++task)
+    {
+        uint32_t cycles[2];
+        memcpy(cycles, tasks + 8 * task, sizeof cycles);
+        Serial.print("  Задача "), Serial.print(task);
+        Serial.print(": max "), Serial.print(cycles[0]), Serial.print(" тактов, avg "), Serial.print(cycles[1]), Serial.println(" тактов");
+    }
+}
+
+// Чтение и вывод статистики планировщика ведомого: заголовок (16 байт) и по 8 байт на задачу
+void readSchedulerStats()
+{
+    uint8_t buffer[32];
+    if (!requestStats(CMD_READ_SCHEDULER, buffer, 16) || 16U + 8U * buffer[15] > sizeof buffer ||
+        !requestStats(CMD_READ_SCHEDULER, buffer, 16 + 8 * buffer[15])) // Размер зависит от количества задач в заголовке
+    {
+        Serial.println("Ошибка чтения статистики планировщика");
+        return;
+    }
+    uint32_t header[3];
+    uint16_t load;
+    memcpy(header, buffer, sizeof header), memcpy(&load, buffer + 12, sizeof load);
+    Serial.print("Тиков: "), Serial.print(header[0]);
+    Serial.print(", джиттер max "), Serial.print(header[1] / SLAVE_CPU_MHZ);
+    Serial.print(" мкс, задержка запуска max "), Serial.print(header[2] / SLAVE_CPU_MHZ);
+    Serial.print(" мкс, пропущено тиков "), Serial.print(buffer[14]);
+    Serial.print(", загрузка "), Serial.print(load / 10.0, 1), Serial.println(" %");
+    printTaskCycles(buffer + 16, buffer[15]);
+}
+
+// Чтение и вывод статистики сопрограмм ведомого: заголовок (8 байт) и по 8 байт на задачу
+void readCoroutineStats()
+{
+    uint8_t buffer[32];
+    if (!requestStats(CMD_READ_COROUTINES, buffer, 8) || 8U + 8U * buffer[4] > sizeof buffer ||
+        !requestStats(CMD_READ_COROUTINES, buffer, 8 + 8 * buffer[4]))
+    {
+        Serial.println("Ошибка чтения статистики сопрограмм");
+        return;
+    }
+    uint32_t overhead;
+    memcpy(&overhead, buffer, sizeof overhead);
+    Serial.print("Накладные расходы прохода: "), Serial.print(overhead), Serial.println(" тактов");
+    printTaskCycles(buffer + 8, buffer[4]);
+}
+
+// Чтение и вывод статистики очереди команд ведомого: худшее время обработчика приёма, глубина, заполнение, переполнения
+void readQueueStats()
+{
+    uint8_t buffer[8];
+    if (!requestStats(CMD_READ_QUEUE, buffer, sizeof buffer))
+    {
+        Serial.println("Ошибка чтения статистики очереди команд");
+        return;
+    }
+    uint32_t isrCycles;
+    memcpy(&isrCycles, buffer, sizeof isrCycles);
+    Serial.print("Обработчик приёма: худшее "), Serial.print(isrCycles), Serial.print(" тактов (");
+    Serial.print((float)isrCycles / SLAVE_CPU_MHZ, 1), Serial.println(" мкс)");
+    Serial.print("Очередь: ячеек "), Serial.print(buffer[4]), Serial.print(", ожидают "), Serial.print(buffer[5]);
+    Serial.print(", максимум "), Serial.print(buffer[6]), Serial.print(", отброшено "), Serial.println(buffer[7]);
+}
+
+// Чтение и вывод счётчиков работоспособности ведомого: время работы, транзакции I2C, нажатия по типам,
+// отклонённые команды, сбросы сторожевым таймером, худшая задержка основного цикла и остановка на операции с flash
+void readHealth()
+{
+    uint8_t buffer[32];
+    if (!requestStats(CMD_READ_HEALTH, buffer, sizeof buffer))
+    {
+        Serial.println("Ошибка чтения счётчиков работоспособности");
+        return;
+    }
+    uint32_t values[4]; // Время работы, записи, чтения, худшая задержка основного цикла
+    uint16_t counters[8]; // Нажатия (5 типов), отклонённые команды, сбросы сторожевым таймером, остановка на flash (мкс)
+    memcpy(values, buffer, sizeof values), memcpy(counters, buffer + sizeof values, sizeof counters);
+    Serial.print("Время работы "), Serial.print(values[0]), Serial.print(" с, записей I2C "), Serial.print(values[1]);
+    Serial.print(", чтений "), Serial.println(values[2]);
+    Serial.print("\"Громкость -\": кратковременных "), Serial.print(counters[0]), Serial.print(", длительных "), Serial.println(counters[1]);
+    Serial.print("\"Громкость +\": кратковременных "), Serial.print(counters[2]), Serial.print(", длительных "), Serial.println(counters[3]);
+    Serial.print("Аккордов "), Serial.print(counters[4]), Serial.print(", отклонённых команд "), Serial.print(counters[5]);
+    Serial.print(", сбросов сторожевым таймером "), Serial.println(counters[6]);
+    Serial.print("Худшая задержка основного цикла "), Serial.print(values[3]), Serial.print(" тактов (");
+    Serial.print((float)values[3] / SLAVE_CPU_MHZ, 1), Serial.println(" мкс)");
+    Serial.print("Худшая остановка на операции с flash "), Serial.print(counters[7]), Serial.println(" мкс");
+}
+
+// Запись сохраняемой настройки ведомого: "set <ключ> <значение>" (ключ 0 – подписка, 1 – светодиоды при запуске)
+void writeSetting(const String &args)
+{
+    char *end;
+    uint8_t key = strtoul(args.c_str(), &end, 0);
+    uint16_t value = strtoul(end, NULL, 0);
+    Wire.beginTransmission(SLAVE_ADDRESS);
+    Wire.write(CMD_WRITE_SETTING), Wire.write(key), Wire.write((const uint8_t *)&value, sizeof value);
+    Serial.print(Wire.endTransmission() == 0 ? "Настройка " : "Ошибка записи настройки ");
+    Serial.print(key), Serial.print(" = 0x"), Serial.println(value, HEX);
+}
+
+// Чтение сохраняемой настройки ведомого: "get <ключ>" (значение, задано ли, ожидает ли записи во flash)
+void readSetting(uint8_t key)
+{
+    Wire.beginTransmission(SLAVE_ADDRESS);
+    Wire.write(CMD_READ_SETTING), Wire.write(key);
+    if (Wire.endTransmission(false) != 0 || Wire.requestFrom(SLAVE_ADDRESS, 4) != 4)
+    {
+        Serial.println("Ошибка чтения настройки");
+        return;
+    }
+    uint8_t buffer[4]; // Значение (uint16_t), ключ, флаги
+    for (uint8_t i = 0; i < sizeof buffer; ++i)
+        buffer[i] = Wire.read();
+    uint16_t value = buffer[0] | (buffer[1] << 8);
+    uint8_t flags = buffer[3];
+    Serial.print("Настройка "), Serial.print(key);
+    if (!(flags & 0x01))
+    {
+        Serial.println(" не задана");
+        return;
+    }
+    Serial.print(" = 0x"), Serial.print(value, HEX), Serial.println(flags & 0x02 ? " (ожидает записи во flash)" : "");
+}
+
+// Чтение и вывод статистики хранилища настроек ведомого: худшая задержка операции с flash, стирания, записи, заполнение
+void readStoreStats()
+{
+    uint8_t buffer[16];
+    if (!requestStats(CMD_READ_STORE, buffer, sizeof buffer))
+    {
+        Serial.println("Ошибка чтения статистики хранилища");
+        return;
+    }
+    uint32_t stallCycles;
+    uint16_t counters[5]; // Поколение, стирания, записи, занято, ёмкость страницы
+    memcpy(&stallCycles, buffer, sizeof stallCycles), memcpy(counters, buffer + 4, sizeof counters);
+    if (!buffer[15])
+    {
+        Serial.println("Хранилище отключено: страницы flash заняты прошивкой");
+        return;
+    }
+    Serial.print("Хранилище: поколение "), Serial.print(counters[0]), Serial.print(", стираний "), Serial.print(counters[1]);
+    Serial.print(", записей "), Serial.print(counters[2]), Serial.print(", занято "), Serial.print(counters[3]);
+    Serial.print(" из "), Serial.print(counters[4]), Serial.print(", ожидают "), Serial.println(buffer[14]);
+    Serial.print("Худшая операция с flash "), Serial.print(stallCycles), Serial.print(" тактов (");
+    Serial.print((float)stallCycles / SLAVE_CPU_MHZ / 1000, 2), Serial.println(" мс)");
+}
+
+// Чтение одной записи журнала транзакций I2C ведомого (номер от последней) одной транзакцией с повторным START
+bool readTraceRecord(uint8_t back, uint8_t *buffer)
+{
+    Wire.beginTransmission(SLAVE_ADDRESS);
+    Wire.write(CMD_READ_TRACE), Wire.write(back);
+    if (Wire.endTransmission(false) != 0 || Wire.requestFrom(SLAVE_ADDRESS, TRACE_RECORD_SIZE) != TRACE_RECORD_SIZE)
+        return false;
+    for (uint8_t i = 0; i < TRACE_RECORD_SIZE; ++i)
+        buffer[i] = Wire.read();
+    return true;
+}
+
+// Выгрузка журнала транзакций I2C ведомого от старых записей к новым: строки "TRACE <hex>" с ответами команды 0x53
+// (заголовок и запись) для расшифровки tools/i2c_trace.py. Записи запрашиваются по номеру транзакции: если за время
+// выгрузки ведомый записал новые транзакции (другой ведущий на шине), номер от последней пересчитывается.
+void dumpTrace()
+{
+    uint8_t buffer[TRACE_RECORD_SIZE];
+    uint16_t count, stored, seq;
+    if (!readTraceRecord(0, buffer))
+    {
+        Serial.println("Ошибка чтения журнала транзакций");
+        return;
+    }
+    memcpy(&count, buffer, sizeof count), memcpy(&stored, buffer + 2, sizeof stored);
+    Serial.print("Журнал I2C: транзакций "), Serial.print(count), Serial.print(", записей "), Serial.println(stored);
+    for (uint16_t next = count - stored, end = count; next != end;)
+    {
+        uint16_t back = count - 1 - next;
+        if (back >= stored)
+        {
+            ++next; // Запись вытеснена новыми транзакциями
+            continue;
+        }
+        if (!readTraceRecord(back, buffer))
+        {
+            Serial.println("Ошибка чтения журнала транзакций");
+            return;
+        }
+        memcpy(&count, buffer, sizeof count), memcpy(&seq, buffer + 8, sizeof seq);
+        if (seq != next)
+            continue; // Номера от последней сдвинулись – повтор с новым количеством транзакций
+        Serial.print("TRACE ");
+        for (uint8_t i = 0; i < TRACE_RECORD_SIZE; ++i)
+            Serial.print(buffer[i] >> 4, HEX), Serial.print(buffer[i] & 0x0F, HEX);
+        Serial.println(), ++next;
+    }
+}
+
+// Имитатор энкодера: формирует на выходах ENC_SIM_PIN_A/B квадратурный сигнал на заданное число щелчков
+// (4 перехода кода Грея на щелчок, знак задаёт направление), затем читает у ведомого накопленное
+// приращение командой 0x45 и сравнивает его с ожидаемым.
+void simulateEncoder(long detents)
+{
+    static const uint8_t QUADRATURE[4] = {0b00, 0b01, 0b11, 0b10}; // Состояния (B:A) при вращении вперёд (A опережает B)
+    static uint8_t phase = 0;
+    pinMode(ENC_SIM_PIN_A, OUTPUT), pinMode(ENC_SIM_PIN_B, OUTPUT);
+    for (long i = 0; i < labs(detents) * 4; ++i)
+    {
+        phase = (phase + (detents > 0 ? 1 : 3)) & 3;
+        digitalWrite(ENC_SIM_PIN_A, QUADRATURE[phase] & 1);
+        digitalWrite(ENC_SIM_PIN_B, QUADRATURE[phase] >> 1);
+        delayMicroseconds(ENC_SIM_STEP_US);
+    }
+
+    long received = 0; // Приращение может не поместиться в один ответ – читаем, пока ведомый не вернёт 0
+    for (int8_t delta = 1; delta != 0; received += delta)
+    {
+        Wire.beginTransmission(SLAVE_ADDRESS);
+        Wire.write(CMD_READ_ENCODER);
+        if (Wire.endTransmission(false) != 0 || Wire.requestFrom(SLAVE_ADDRESS, 2) != 2)
+        {
+            Serial.println("Ошибка чтения энкодера");
+            return;
+        }
+        printButtonState(Wire.read());
+        delta = (int8_t)Wire.read();
+    }
+    Serial.print("Энкодер: отправлено "), Serial.print(detents);
+    Serial.print(", получено "), Serial.print(received);
+    Serial.println(received == detents ? " – OK" : " – ОШИБКА");
+}
+
+// Стресс-тест шины: N итераций записи случайной маски светодиодов (с битом 7) и её чтения обратно
+// в одной транзакции (повторный START между записью и чтением).
+// Итерации выполняются без пауз, по завершении в монитор выводится пропускная способность,
+// количество NACK, количество несовпадений и распределение задержек цикла "запись + чтение".
+void stressTest(uint32_t iterations)
+{
+    uint32_t nacks = 0, mismatches = 0, completed = 0;
+    uint32_t minLatency = UINT32_MAX, maxLatency = 0;
+    uint64_t sumLatency = 0;
+    uint32_t histogram[STRESS_LATENCY_BUCKETS] = {}; // Интервал k: задержка < 128 << k мкс (последний – все остальные)
+
+    uint32_t startTime = micros();
+    for (uint32_t i = 0; i < iterations; ++i)
+    {
+        uint8_t expected = (uint8_t)random(0x40) | 0x80; // Бит 7 – следующее чтение вернёт состояние светодиодов
+        uint32_t t0 = micros();
+
+        Wire.beginTransmission(SLAVE_ADDRESS);
+        Wire.write(CMD_WRITE_LED);
+        Wire.write(expected);
+        if (Wire.endTransmission(false) != 0 || Wire.requestFrom(SLAVE_ADDRESS, 1) != 1)
+        {
+            ++nacks;
+            continue;
+        }
+        uint8_t data = Wire.read();
+        uint32_t latency = micros() - t0;
+
+        mismatches += (data != expected);
+        ++completed;
+        sumLatency += latency;
+        minLatency = min(minLatency, latency);
+        maxLatency = max(maxLatency, latency);
+        uint8_t bucket = 0;
+        while (bucket < STRESS_LATENCY_BUCKETS - 1 && latency >= (128UL << bucket))
+            ++bucket;
+        ++histogram[bucket];
+    }
+    uint32_t elapsed = micros() - startTime;
+
+    Serial.print("Стресс-тест: итераций "), Serial.print(iterations);
+    Serial.print(", за "), Serial.print(elapsed), Serial.println(" мкс");
+    Serial.print("Циклов запись+чтение/с: "), Serial.println(elapsed ? completed * 1e6 / elapsed : 0.0, 1);
+    Serial.print("Байт I2C/с (5 за цикл, с адресами): "), Serial.println(elapsed ? completed * 5e6 / elapsed : 0.0, 1);
+    Serial.print("NACK: "), Serial.print(nacks), Serial.print("\tНесовпадений: "), Serial.println(mismatches);
+    if (completed == 0)
+        return;
+    Serial.print("Задержка, мкс: min "), Serial.print(minLatency);
+    Serial.print(", avg "), Serial.print((uint32_t)(sumLatency / completed));
+    Serial.print(", max "), Serial.println(maxLatency);
+    for (uint8_t k = 0; k < STRESS_LATENCY_BUCKETS; ++k)
+    {
+        (k < STRESS_LATENCY_BUCKETS - 1) ? (Serial.print("  < "), Serial.print(128UL << k))
+                                         : (Serial.print("  >= "), Serial.print(128UL << (k - 1)));
+        Serial.print(" мкс: "), Serial.println(histogram[k]);
     }
 }
 
@@ -57,7 +715,67 @@ void loop()
     {
         String input = Serial.readStringUntil('\n');
         input.trim();
-        if (input.length() > 0)
+        if (input == "timing")
+            readTiming(); // Команда "timing" – чтение временных меток нажатий
+        else if (input == "gestures")
+            readGestures(); // Команда "gestures" – чтение серий касаний
+        else if (input == "debounce")
+            readDebounce(); // Команда "debounce" – параметры адаптивного устранения дребезга
+        else if (input == "leds")
+            readLeds(); // Команда "leds" – чтение состояния светодиодов (повторный START)
+        else if (input.startsWith("dual"))
+            dualAddressLeds(strtoul(input.substring(4).c_str(), NULL, 0)); // Команда "dual <маска>" – светодиоды по адресу 0x21
+        else if (input.startsWith("subscribe"))
+            subscribe(input.substring(9)); // Команда "subscribe <состояние> <жесты> [change]" – подписка на события
+        else if (input.startsWith("broadcast"))
+            broadcastLeds(input.substring(9)); // Команда "broadcast <маска> [группы]" – светодиоды всех клавиатур общим вызовом
+        else if (input.startsWith("alert"))
+            comparePolling(max(1L, input.substring(5).toInt())); // Команда "alert [с]" – опрос по SMBALERT# против циклического
+        else if (input.startsWith("events"))
+            readEvents(input.substring(6).toInt()); // Команда "events [N]" – чтение журнала событий с N % потерянных ответов
+        else if (input == "matrix")
+            readKeyMasks(CMD_READ_MATRIX, "Матрица"); // Команда "matrix" – чтение состояния матрицы клавиш
+        else if (input == "expander")
+            readKeyMasks(CMD_READ_EXPANDER, "Панель расширения"); // Команда "expander" – чтение клавиш панели расширения
+        else if (input.startsWith("outputs"))
+        {
+            // Команда "outputs <hex>" – запись 32 выходов панели расширения (бит 0 – первый выход первого 74HC595)
+            uint32_t outputs = strtoul(input.substring(7).c_str(), nullptr, 16);
+            Wire.beginTransmission(SLAVE_ADDRESS);
+            Wire.write(CMD_WRITE_EXPANDER), Wire.write((const uint8_t *)&outputs, sizeof outputs);
+            Serial.println(Wire.endTransmission() == 0 ? "Выходы панели записаны" : "Ошибка передачи по I2C");
+        }
+        else if (input == "sched")
+            readSchedulerStats(); // Команда "sched" – статистика планировщика ведомого
+        else if (input == "queue")
+            readQueueStats(); // Команда "queue" – статистика очереди команд ведомого
+        else if (input.startsWith("set"))
+            writeSetting(input.substring(3)); // Команда "set <ключ> <значение>" – запись сохраняемой настройки
+        else if (input.startsWith("get"))
+            readSetting(strtoul(input.substring(3).c_str(), NULL, 0)); // Команда "get <ключ>" – чтение настройки
+        else if (input == "store")
+            readStoreStats(); // Команда "store" – статистика хранилища настроек
+        else if (input == "health")
+            readHealth(); // Команда "health" – счётчики работоспособности ведомого
+        else if (input == "trace")
+            dumpTrace(); // Команда "trace" – выгрузка журнала транзакций I2C ведомого
+        else if (input == "coro")
+            readCoroutineStats(); // Команда "coro" – статистика сопрограмм ведомого
+        else if (input.startsWith("pattern"))
+        {
+            String args = input.substring(7);
+            args.trim();
+            sendPattern(args); // Команда "pattern <мс> <маски...>" / "pattern stop" – шаблон светодиодов
+        }
+        else if (input.startsWith("encoder"))
+            simulateEncoder(input.substring(7).toInt()); // Команда "encoder N" – имитация N щелчков энкодера (N < 0 – обратно)
+        else if (input.startsWith("stress"))
+        {
+            // Команда "stress [N]" – стресс-тест на N итераций (по умолчанию STRESS_DEFAULT_ITERATIONS)
+            long iterations = input.substring(6).toInt();
+            stressTest(iterations > 0 ? iterations : STRESS_DEFAULT_ITERATIONS);
+        }
+        else if (input.length() > 0)
         {
             // Интерпретация введённого значения.
             // Поддерживается ввод в десятичном формате или в виде шестнадцатеричного значения (начинается с "0x").
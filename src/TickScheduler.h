@@ -0,0 +1,153 @@
+#ifndef TICK_SCHEDULER_H
+#define TICK_SCHEDULER_H
+
+#include <Arduino.h>
+#include "SnapshotBuffer.h"
+
+/**
+ * @brief Описание периодической задачи планировщика.
+ */
+struct SchedulerTask
+{
+    void (*function)(); ///< Функция задачи.
+    uint16_t period;    ///< Период запуска в тиках.
+    uint16_t phase;     ///< Смещение запуска в тиках (для разнесения задач с одинаковым периодом по разным тикам).
+};
+
+/**
+ * @brief Планировщик задач с фиксированной частотой тиков от аппаратного таймера.
+ *
+ * Прерывание таймера только отмечает наступление тика и измеряет джиттер своего периода.
+ * Задачи выполняются в основном цикле (run()) в порядке таблицы, а время между тиками процессор
+ * проводит в режиме сна (WFI), из которого его выводит тик или любое другое прерывание (например, I2C).
+ * Для каждой задачи измеряется время выполнения в тактах; раз в секунду публикуется снимок статистики:
+ * загрузка процессора, среднее и худшее время задач, худший джиттер тика и задержка запуска задач.
+ *
+ * @tparam TaskCount Количество задач в таблице.
+ */
+template <uint8_t TaskCount>
+class TickScheduler
+{
+public:
+    /**
+     * @brief Статистика планировщика в том виде, в котором она передаётся по I2C (little-endian).
+     * Худшие значения накапливаются с момента запуска, средние и загрузка – за последнюю секунду.
+     */
+    struct Stats
+    {
+        uint32_t ticks;            ///< Количество обработанных тиков.
+        uint32_t maxJitterCycles;  ///< Худшее отклонение периода прерывания тика от номинального, тактов.
+        uint32_t maxLatencyCycles; ///< Худшая задержка от прерывания тика до запуска задач, тактов.
+        uint16_t loadPermille;     ///< Загрузка процессора задачами, промилле.
+        uint8_t overruns;          ///< Количество пропущенных тиков (задачи не уложились в период), до 255.
+        uint8_t taskCount;         ///< Количество задач.
+        struct
+        {
+            uint32_t maxCycles; ///< Худшее время выполнения, тактов.
+            uint32_t avgCycles; ///< Среднее время выполнения, тактов.
+        } tasks[TaskCount];        ///< Время выполнения задач в порядке таблицы.
+    };
+
+    /**
+     * @brief Конструктор класса TickScheduler.
+     * @param tasks Таблица задач (TaskCount элементов).
+     * @param tickRate Частота тиков в герцах.
+     */
+    TickScheduler(const SchedulerTask *tasks, uint32_t tickRate) : tasks(tasks), tickRate(tickRate) { stats.taskCount = TaskCount; }
+
+    /**
+     * @brief Запускает таймер тиков.
+     * @param instance Таймер, прерывание которого формирует тики.
+     */
+    void begin(TIM_TypeDef *instance)
+    {
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk; // Счётчик тактов для измерения времени
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+        tickPeriodCycles = SystemCoreClock / tickRate;
+        tickCycles = DWT->CYCCNT;
+        timer = new HardwareTimer(instance);
+        timer->setOverflow(tickRate, HERTZ_FORMAT);
+        timer->attachInterrupt([this] { onTick(); });
+        timer->resume();
+    }
+
+    /**
+     * @brief Ожидает следующего тика в режиме сна и выполняет задачи, срок которых наступил.
+     * Вызывается из loop().
+     */
+    void run()
+    {
+        __disable_irq();
+        while (!pendingTicks)
+        {
+            __WFI(); // Прерывание, пришедшее после проверки, не даст уснуть: WFI завершается по ожидающему прерыванию
+            __enable_irq(), __disable_irq();
+        }
+        uint8_t elapsed = pendingTicks;
+        uint32_t start = DWT->CYCCNT, latency = start - tickCycles;
+        pendingTicks = 0;
+        __enable_irq();
+
+        stats.overruns = min<uint32_t>(stats.overruns + elapsed - 1, 0xFF);
+        stats.maxLatencyCycles = max(stats.maxLatencyCycles, latency);
+        uint32_t tick = stats.ticks++;
+        for (uint8_t i = 0; i < TaskCount; ++i)
+            if (tick % tasks[i].period == tasks[i].phase)
+            {
+                uint32_t t0 = DWT->CYCCNT;
+                tasks[i].function();
+                uint32_t cycles = DWT->CYCCNT - t0;
+                stats.tasks[i].maxCycles = max(stats.tasks[i].maxCycles, cycles);
+                taskCycles[i] += cycles, ++taskRuns[i];
+            }
+        busyCycles += DWT->CYCCNT - start;
+
+        if (stats.ticks % tickRate == 0) // Раз в секунду – средние значения за окно и публикация снимка
+        {
+            stats.loadPermille = busyCycles / (SystemCoreClock / 1000);
+            for (uint8_t i = 0; i < TaskCount; ++i)
+                stats.tasks[i].avgCycles = taskRuns[i] ? taskCycles[i] / taskRuns[i] : 0, taskCycles[i] = taskRuns[i] = 0;
+            busyCycles = 0;
+            stats.maxJitterCycles = maxJitterCycles;
+            published.publish(stats);
+        }
+    }
+
+    /**
+     * @brief Копирует последний опубликованный снимок статистики. Безопасно вызывать из прерывания.
+     * @param out Приёмник снимка.
+     */
+    void readStats(Stats &out) const { published.read(out); }
+
+    uint32_t maxLatencyCycles() const { return stats.maxLatencyCycles; } ///< @brief Худшая задержка запуска задач с момента запуска, тактов. Безопасно вызывать из прерывания.
+
+private:
+    /**
+     * @brief Обработчик прерывания тика: отметка тика и измерение джиттера периода.
+     */
+    void onTick()
+    {
+        uint32_t now = DWT->CYCCNT, interval = now - tickCycles;
+        uint32_t jitter = interval > tickPeriodCycles ? interval - tickPeriodCycles : tickPeriodCycles - interval;
+        if (pendingTicks == 0 && jitter > maxJitterCycles) // Пропущенные тики искажают измерение – учитываем только штатные
+            maxJitterCycles = jitter;
+        tickCycles = now;
+        if (pendingTicks < 0xFF)
+            ++pendingTicks;
+    }
+
+    const SchedulerTask *const tasks;        ///< Таблица задач.
+    const uint32_t tickRate;                 ///< Частота тиков, Гц.
+    HardwareTimer *timer = nullptr;          ///< Таймер тиков.
+    uint32_t tickPeriodCycles = 0;           ///< Номинальный период тика в тактах.
+    volatile uint32_t tickCycles = 0;        ///< Значение счётчика тактов в последнем прерывании тика.
+    volatile uint32_t maxJitterCycles = 0;   ///< Худшее отклонение периода тика, тактов.
+    volatile uint8_t pendingTicks = 0;       ///< Количество тиков, ожидающих обработки.
+    uint32_t busyCycles = 0;                 ///< Время выполнения задач за текущее окно, тактов.
+    uint32_t taskCycles[TaskCount] = {};     ///< Суммарное время задач за текущее окно, тактов.
+    uint32_t taskRuns[TaskCount] = {};       ///< Количество запусков задач за текущее окно.
+    Stats stats = {};                        ///< Накапливаемая статистика.
+    SnapshotBuffer<Stats> published;         ///< Последний опубликованный снимок статистики.
+};
+
+#endif // TICK_SCHEDULER_H
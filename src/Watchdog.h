@@ -0,0 +1,45 @@
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include <Arduino.h>
+
+/**
+ * @brief Независимый сторожевой таймер (IWDG) со счётчиком сбросов в резервном регистре.
+ *
+ * IWDG тактируется от LSI (~40 кГц) и сбрасывает микроконтроллер, если refresh() не вызывался дольше таймаута.
+ * Количество сбросов сторожевым таймером хранится в резервном регистре BKP->DR1: он не очищается при сбросе
+ * и обнуляется только при отключении питания резервного домена (на bluepill VBAT соединён с 3.3 В).
+ * При остановке отладчиком таймер не считает.
+ */
+class Watchdog
+{
+public:
+    /**
+     * @brief Учитывает причину сброса и запускает таймер. Остановить IWDG после запуска невозможно.
+     * @param timeoutMs Таймаут, мс (до 3276 мс).
+     * @param resetFlags Флаги причины сброса (RCC->CSR[31:24]).
+     */
+    void begin(uint16_t timeoutMs, uint8_t resetFlags)
+    {
+        RCC->APB1ENR |= RCC_APB1ENR_PWREN | RCC_APB1ENR_BKPEN;
+        PWR->CR |= PWR_CR_DBP; // Запись в резервные регистры
+        if (resetFlags & ((RCC_CSR_IWDGRSTF | RCC_CSR_WWDGRSTF) >> 24))
+            BKP->DR1 = (uint16_t)(BKP->DR1 + 1);
+        resets = BKP->DR1;
+
+        DBGMCU->CR |= DBGMCU_CR_DBG_IWDG_STOP;
+        IWDG->KR = 0x5555; // Доступ к PR и RLR
+        IWDG->PR = 3;      // LSI / 32: 1.25 кГц
+        IWDG->RLR = min<uint32_t>(timeoutMs * 5UL / 4, 0xFFF);
+        IWDG->KR = 0xAAAA, IWDG->KR = 0xCCCC; // Загрузка счётчика и запуск
+    }
+
+    void refresh() { IWDG->KR = 0xAAAA; } ///< @brief Перезапускает отсчёт таймаута.
+
+    uint16_t resetCount() const { return resets; } ///< @brief Количество сбросов сторожевым таймером с включения питания.
+
+private:
+    uint16_t resets = 0; ///< Значение счётчика сбросов при запуске.
+};
+
+#endif // WATCHDOG_H
@@ -11,7 +11,57 @@
  *   должна вернуть состояние светодиодов.
  * - Команда чтения (0x41) возвращает:
  *   - Состояние светодиодов (с установленным битом 7), если в предыдущей записи был запрошен режим чтения LED.
- *   - Или состояние кнопок с учётом фильтрации дребезга и определением кратковременного/длительного нажатия.
+ *   - Или состояние кнопок с учётом фильтрации дребезга и определением кратковременного/длительного нажатия
+ *     (бит [6] – одновременное нажатие обеих кнопок).
+ * - Команда (0x51) без данных задаёт, что следующая операция чтения вернёт состояние светодиодов (как бит [7] команды 0x40),
+ *   не изменяя их.
+ * - Команда (0x42) без данных задаёт, что следующая операция чтения вернёт временные метки нажатий
+ *   (см. requestEvent()).
+ * - Команда (0x43) без данных задаёт, что следующая операция чтения вернёт байт жестов (серий касаний).
+ * - Команда (0x48) без данных задаёт, что следующая операция чтения вернёт параметры адаптивного
+ *   устранения дребезга кнопок (см. DebounceInfo).
+ * - Команда (0x4F), переданная общим вызовом (адрес 0x00), задаёт состояние светодиодов всех клавиатур на шине
+ *   (или только входящих в группы из маски) одной транзакцией.
+ * - Команда (0x50) задаёт подписку ведущего: маски событий байта состояния и байта жестов, о которых он хочет знать,
+ *   и режим "только изменения", в котором готовность (SMBALERT#) сигнализируется лишь по подписанным событиям.
+ * - Команда (0x4D) задаёт, что следующая операция чтения вернёт неподтверждённые записи журнала событий кнопок
+ *   (см. ButtonEvent); записи удаляются только командой подтверждения (0x4E), поэтому чтение можно повторять.
+ * - Команда (0x55) записывает сохраняемую настройку (ключ, uint16_t), команды (0x56, 0x57) выбирают чтение настройки
+ *   и статистики хранилища; настройки хранятся во flash (см. FlashStore) и применяются при запуске.
+ * - Команда (0x54) без данных задаёт, что следующая операция чтения вернёт счётчики работоспособности (см. HealthStats):
+ *   время работы, транзакции I2C, нажатия по типам, отклонённые команды, сбросы сторожевым таймером, задержку цикла.
+ *
+ * Команда записи и следующее за ней чтение могут выполняться одной транзакцией с повторным START (чтение регистра):
+ * тогда другой ведущий не может вклиниться между ними и перехватить выбранный режим чтения.
+ *
+ * При сборке с KEY_MATRIX дополнительно сканируется матрица клавиш KEY_MATRIX_ROWS x 4 (см. KeyMatrix),
+ * состояние которой читается командой 0x44.
+ * При сборке с ROTARY_ENCODER на PA8/PA9 подключается энкодер громкости (см. RotaryEncoder),
+ * приращение которого читается командой 0x45 вместе с байтом состояния кнопок.
+ *
+ * При сборке с EDGE_CAPTURE фронты кнопок PA6/PA7 фиксируются каналами захвата TIM3 с аппаратным входным
+ * фильтром (см. EdgeCapture), и кнопки обрабатываются по точным моментам фронтов без чтения пинов.
+ *
+ * При сборке с LED_PATTERN ведущий может загрузить шаблон масок светодиодов (0x49) и запускать/останавливать
+ * его воспроизведение (0x4A); кадры выводятся в GPIOA->BSRR по DMA от TIM4 без участия процессора (см. LedPattern).
+ *
+ * При сборке с SHIFT_EXPANDER к SPI2 подключается панель расширения на 74HC595/74HC165 (см. ShiftRegisterPanel):
+ * 32 выхода задаются командой 0x4B, состояние 32 клавиш читается командой 0x4C (в формате команды 0x44).
+ *
+ * При сборке с SMBUS_ALERT клавиатура с непрочитанными событиями удерживает SMBALERT# (PB5) и отвечает своим адресом
+ * на чтение адреса ответа на прерывание 0x0C (см. SmbusAlert).
+ *
+ * При сборке с I2C_TRACE последние 32 транзакции I2C (направление, первые байты, длина, время, результат) записываются
+ * в журнал в неинициализируемой RAM, который переживает тёплый сброс и читается командой 0x53 (см. I2cTrace,
+ * tools/i2c_trace.py).
+ *
+ * При сборке с DUAL_ADDRESS слейв дополнительно отвечает на адрес светодиодов 0x21 (второй собственный адрес, OAR2):
+ * запись одного байта по нему задаёт светодиоды, чтение возвращает их состояние – без байта команды.
+ *
+ * Опрос кнопок выполняется задачей планировщика с фиксированной частотой (1 кГц, тики от TIM2),
+ * между тиками процессор находится в режиме сна.
+ * При сборке с COROUTINE_TASKS (C++20) выполнение команд I2C, опрос кнопок и обновление светодиодов выполняются
+ * сопрограммами CoScheduler поверх тиков планировщика; их статистика читается командой 0x47.
  *
  * Клавиатура имеет две кнопки ("Громкость +" и "Громкость -") с обработкой дребезга и
  * определением времени нажатия (порог 500 мс). Состояние кнопок возвращается при чтении по I2C.
@@ -20,39 +70,839 @@
 #include <Arduino.h>
 #include <Wire.h>
 #include "ButtonHandler.h"
+#include "ChordDetector.h"
+#include "SnapshotBuffer.h"
+#include "EventLog.h"
+#include "CommandQueue.h"
+#include "I2cTrace.h"
+#include "TickScheduler.h"
+#include "Watchdog.h"
+#include "FlashStore.h"
+#ifdef KEY_MATRIX
+#include "KeyMatrix.h"
+#endif
+#ifdef ROTARY_ENCODER
+#include "RotaryEncoder.h"
+#endif
+#ifdef COROUTINE_TASKS
+#include "CoroutineScheduler.h"
+#endif
+#ifdef EDGE_CAPTURE
+#include "EdgeCapture.h"
+#endif
+#ifdef LED_PATTERN
+#include "LedPattern.h"
+#endif
+#ifdef SHIFT_EXPANDER
+#include "ShiftRegisterPanel.h"
+#endif
+#ifdef SMBUS_ALERT
+#include "SmbusAlert.h"
+#endif
+#ifdef DUAL_ADDRESS
+#include "I2cSecondAddress.h"
+#endif
 
 static const uint8_t I2C_SLAVE_ADDRESS = 0x20;                    ///< Адрес I2C-слейва.
 static const uint8_t CMD_WRITE_LED = 0x40;                        ///< Код команды для записи состояния светодиодов.
+static const uint8_t CMD_READ_TIMING = 0x42;                      ///< Код команды чтения временных меток нажатий.
+static const uint8_t CMD_READ_GESTURES = 0x43;                    ///< Код команды чтения байта жестов.
+static const uint8_t CMD_READ_DEBOUNCE = 0x48;                    ///< Код команды чтения параметров адаптивного устранения дребезга.
+static const uint8_t CMD_READ_EVENTS = 0x4D;                      ///< Код команды чтения журнала событий кнопок.
+static const uint8_t CMD_ACK_EVENTS = 0x4E;                       ///< Код команды подтверждения записей журнала событий.
+static const uint8_t CMD_BROADCAST_LED = 0x4F;                    ///< Код команды записи светодиодов общим вызовом (всем клавиатурам).
+static const uint8_t CMD_SUBSCRIBE = 0x50;                        ///< Код команды задания подписки на события.
+static const uint8_t SUBSCRIBE_CHANGE_ONLY = 0x01;                ///< Флаг CMD_SUBSCRIBE: готовность только по подписанным событиям.
+static volatile uint8_t subscribedEvents = 0x7F;                  ///< Подписка на биты байта состояния (биты 0 и 3 – нажатие/отпускание).
+static volatile uint8_t subscribedGestures = 0x3F;                ///< Подписка на биты байта жестов.
+static volatile bool changeOnly = false;                          ///< Режим "только изменения" (SUBSCRIBE_CHANGE_ONLY).
+static const uint8_t CMD_READ_LED = 0x51;                         ///< Код команды выбора чтения состояния светодиодов.
+static const uint8_t CMD_READ_QUEUE = 0x52;                       ///< Код команды чтения статистики очереди команд.
+static const uint8_t CMD_READ_TRACE = 0x53;                       ///< Код команды чтения журнала транзакций I2C (сборка с I2C_TRACE).
+static const uint8_t CMD_READ_HEALTH = 0x54;                      ///< Код команды чтения счётчиков работоспособности.
+static const uint8_t CMD_WRITE_SETTING = 0x55;                    ///< Код команды записи сохраняемой настройки.
+static const uint8_t CMD_READ_SETTING = 0x56;                     ///< Код команды чтения сохраняемой настройки.
+static const uint8_t CMD_READ_STORE = 0x57;                       ///< Код команды чтения статистики хранилища настроек.
+#ifndef KEYBOARD_GROUPS
+#define KEYBOARD_GROUPS 0x01 ///< Маска групп, в которые входит клавиатура (для CMD_BROADCAST_LED).
+#endif
 static const uint8_t LED_PINS[] = {PA0, PA1, PA2, PA3, PA4, PA5}; ///< Пины светодиодов
-static const uint8_t BTN_PIN[] = {PA6, PA7};                      ///< Пин кнопки "Громкость +".
 static volatile uint8_t ledState = 0;                             ///< Хранит состояние 6 светодиодов (биты [5:0]).
-static volatile bool lastCommandReadLED = false;                  ///< Флаг, указывающий, что следующая операция чтения должна вернуть состояние светодиодов.
-static const uint64_t debounceDelay = 50 * 1000;                  ///< Задержка для устранения дребезга (50 мс)
+static volatile uint8_t readMode = 0;                             ///< Содержимое ответа на следующую операцию чтения (ReadMode).
+static const uint64_t debounceDelay = 50 * 1000;                  ///< Задержка для устранения дребезга (50 мс; для кнопок громкости – верхняя граница)
 static const uint64_t longPressThreshold = 500 * 1000;            ///< Порог длительного нажатия (500 мс)
+static const uint64_t tapWindow = 300 * 1000;                     ///< Окно ожидания следующего касания серии (300 мс)
+static const uint64_t chordWindow = 100 * 1000;                   ///< Окно распознавания одновременного нажатия (100 мс)
+
+/**
+ * @brief Содержимое ответа на операцию чтения, выбираемое предыдущей командой записи.
+ */
+enum ReadMode : uint8_t
+{
+    READ_BUTTONS,    ///< Байт состояния кнопок (по умолчанию).
+    READ_LED,        ///< Состояние светодиодов с установленным битом 7.
+    READ_TIMING,     ///< Временные метки нажатий (PressTiming для "Громкость -" и "Громкость +").
+    READ_GESTURES,   ///< Байт жестов: серии из 1..3 касаний для "Громкость -" (биты 0–2) и "Громкость +" (биты 3–5).
+    READ_MATRIX,     ///< Маски клавиш матрицы: нажатые, с кратковременным и с длительным нажатием.
+    READ_EXPANDER,   ///< Маски клавиш панели расширения (в формате READ_MATRIX).
+    READ_ENCODER,    ///< Байт состояния кнопок и приращение энкодера громкости.
+    READ_SCHEDULER,  ///< Статистика планировщика (TickScheduler::Stats).
+    READ_COROUTINES, ///< Статистика планировщика сопрограмм (CoScheduler::Stats).
+    READ_DEBOUNCE,   ///< Параметры адаптивного устранения дребезга (DebounceInfo для "Громкость -" и "Громкость +").
+    READ_EVENTS,     ///< Заголовок EventsHeader и неподтверждённые записи журнала событий (ButtonEvent).
+    READ_QUEUE,      ///< Статистика очереди команд (CommandQueue::Stats).
+    READ_TRACE,      ///< Заголовок TraceHeader и запись журнала транзакций I2C (I2cTrace::Entry).
+    READ_HEALTH,     ///< Счётчики работоспособности (HealthStats).
+    READ_SETTING,    ///< Значение сохраняемой настройки (SettingValue).
+    READ_STORE,      ///< Статистика хранилища настроек (FlashStore::Stats).
+};
+
+typedef AdaptiveDebounce<3000, 2000> VolumeDebounce; ///< Дребезг кнопок громкости: задержка от 3 мс до debounceDelay, запас 2 мс.
+typedef StaticButtonHandler<GPIOA_BASE, 6, debounceDelay, longPressThreshold, tapWindow, VolumeDebounce> VolPlusButton;  ///< Кнопка "Громкость +" (PA6).
+typedef StaticButtonHandler<GPIOA_BASE, 7, debounceDelay, longPressThreshold, tapWindow, VolumeDebounce> VolMinusButton; ///< Кнопка "Громкость -" (PA7).
+static VolPlusButton volPlusButton;
+static VolMinusButton volMinusButton;
+static ChordDetector<VolMinusButton, VolPlusButton> volumeChord(volMinusButton, volPlusButton, chordWindow);
+#ifdef EDGE_CAPTURE
+static EdgeCapture buttonCapture(TIM3, PA6, PA7); ///< Захват фронтов: канал 1 – "Громкость +", канал 2 – "Громкость -".
+#endif
+
+/**
+ * @brief Временные метки последнего нажатия кнопки в том виде, в котором они передаются по I2C.
+ */
+struct PressTiming
+{
+    uint32_t pressStartMs; ///< Начало последнего нажатия, мс с момента запуска.
+    uint32_t releaseMs;    ///< Последнее отпускание, мс с момента запуска.
+    uint32_t durationMs;   ///< Длительность последнего завершённого нажатия, мс.
+};
+
+/**
+ * @brief Снимок состояния кнопок, публикуемый основным циклом для обработчика запроса I2C.
+ *
+ * События хранятся как счётчики по модулю 256, индексированные номером бита в байте состояния (или жестов):
+ * обработчик запроса сообщает событие, если счётчик изменился с момента его предыдущего ответа.
+ */
+struct ButtonStatus
+{
+    uint8_t pressed;         ///< Текущее состояние кнопок (биты 0 и 3 байта состояния).
+    uint8_t eventCount[8];   ///< Счётчики событий по номерам битов байта состояния.
+    uint8_t gestureCount[8]; ///< Счётчики жестов по номерам битов байта жестов.
+    PressTiming timing[2];   ///< Временные метки нажатий: [0] – "Громкость -", [1] – "Громкость +".
+    uint8_t notifyCount;     ///< Счётчик снимков с изменениями подписанных типов (по модулю 256).
+    uint16_t pressCount[5];  ///< Накопленные нажатия (HealthStats::presses), независимо от подписки.
+};
+
+static SnapshotBuffer<ButtonStatus> buttonStatus; ///< Последний согласованный снимок состояния кнопок.
+
+/**
+ * @brief Счётчики работоспособности в том виде, в котором они передаются по I2C (little-endian).
+ * Счётчики транзакций и нажатий – с момента запуска, по модулю разрядности.
+ */
+struct HealthStats
+{
+    uint32_t uptimeS;           ///< Время работы с момента запуска, с.
+    uint32_t writes;            ///< Принятые операции записи I2C (все адреса, включая общий вызов).
+    uint32_t reads;             ///< Операции чтения I2C (все адреса).
+    uint32_t maxLatencyCycles;  ///< Худшая задержка от тика до запуска задач основного цикла, тактов.
+    uint16_t presses[5];        ///< Нажатия: кратковременные и длительные "Громкость -", то же "Громкость +", аккорды.
+    uint16_t malformed;         ///< Команды, отклонённые обработчиком приёма (неизвестный код или неполные данные).
+    uint16_t watchdogResets;    ///< Сбросы сторожевым таймером с включения питания.
+    uint16_t maxFlashStallUs;   ///< Худшая остановка основного цикла операцией хранилища настроек с flash, мкс (с насыщением).
+};
+
+static const uint16_t WATCHDOG_TIMEOUT_MS = 500; ///< Таймаут сторожевого таймера (основной цикл не выполнялся).
+static Watchdog watchdog;                         ///< Сторожевой таймер и счётчик вызванных им сбросов.
+static volatile uint32_t tickOverflow = 0;        ///< Переполнения micros(), учтённые get_tick().
+static volatile uint32_t tickLastMicros = 0;      ///< Значение micros() при последнем вызове get_tick().
+static volatile uint32_t busWrites = 0;           ///< Счётчик операций записи I2C (пишет только обработчик приёма).
+static volatile uint32_t busReads = 0;            ///< Счётчик операций чтения I2C (пишет только обработчик запроса).
+static volatile uint16_t malformedFrames = 0;     ///< Счётчик отклонённых команд (пишет только обработчик приёма).
+static volatile uint32_t lastBusActivityMs = 0;   ///< Время последней транзакции I2C, мс (пишут обработчики приёма и запроса).
+static_assert(sizeof(HealthStats) <= 32, "Счётчики работоспособности должны помещаться в буфер Wire");
+
+/**
+ * @brief Возвращает время работы с момента запуска в секундах на момент вызова (из обработчика запроса I2C).
+ *
+ * Время берётся из micros() и счётчика переполнений get_tick() без изменения его состояния, поэтому не зависит
+ * от того, когда последний раз выполнялась задача опроса кнопок (при COROUTINE_TASKS она в покое спит до фронта).
+ * Обработчик прерывания не вытесняется задачей, поэтому micros() не может оказаться старше tickLastMicros
+ * без переполнения.
+ */
+static uint32_t uptimeSeconds()
+{
+    uint32_t now = micros();
+    uint32_t overflow = tickOverflow + (now < tickLastMicros); // Переполнение, ещё не учтённое get_tick()
+    return (((uint64_t)overflow << 32) | now) / 1000000;
+}
+
+/**
+ * @brief Ключи сохраняемых настроек; ключи от SETTING_USER до SETTING_COUNT - 1 ведущий использует по своему усмотрению.
+ */
+enum SettingKey : uint8_t
+{
+    SETTING_SUBSCRIPTION, ///< Подписка при запуске: биты [6:0] – маска байта состояния, бит 7 – "только изменения", биты [13:8] – маска жестов.
+    SETTING_LEDS,         ///< Состояние светодиодов при запуске (биты [5:0]).
+    SETTING_USER,         ///< Первый ключ ведущего (например, громкость или яркость).
+    SETTING_COUNT = 16,   ///< Количество ключей.
+};
+
+/**
+ * @brief Ответ на чтение сохраняемой настройки.
+ */
+struct SettingValue
+{
+    uint16_t value; ///< Значение (0, если не задавалось).
+    uint8_t key;    ///< Ключ.
+    uint8_t flags;  ///< Бит 0 – значение задано, бит 1 – ожидает записи во flash.
+};
+
+typedef FlashStore<Stm32Flash, SETTING_COUNT> SettingsStore;
+static const uint32_t SETTINGS_PAGE0 = FLASH_BASE + 62 * 1024; ///< Предпоследняя страница flash (bluepill_f103c8: 64 КБ).
+static const uint32_t SETTINGS_PAGE1 = FLASH_BASE + 63 * 1024; ///< Последняя страница flash.
+static SettingsStore settings(SETTINGS_PAGE0, SETTINGS_PAGE1);  ///< Сохраняемые настройки (запись во flash – в задаче serviceBus()).
+static const uint32_t FLASH_ERASE_IDLE_MS = 2;                  ///< Пауза на шине, после которой разрешено стирание страницы настроек.
+static volatile uint8_t settingReadKey = 0;                    ///< Ключ настройки для следующего чтения.
+static_assert(sizeof(SettingsStore::Stats) <= 32, "Статистика хранилища должна помещаться в буфер Wire");
+
+/**
+ * @brief Запись журнала событий кнопок в том виде, в котором она передаётся по I2C.
+ */
+struct ButtonEvent
+{
+    uint32_t timeMs;  ///< Момент публикации событий, мс с момента запуска.
+    uint8_t pressed;  ///< Текущее состояние кнопок (биты 0 и 3 байта состояния).
+    uint8_t events;   ///< События в формате байта состояния (биты 1, 2, 4, 5, 6).
+    uint8_t gestures; ///< События в формате байта жестов.
+    uint8_t reserved; ///< Выравнивание.
+};
+
+/**
+ * @brief Заголовок ответа на команду 0x4D.
+ */
+struct EventsHeader
+{
+    uint16_t firstSeq; ///< Номер первой переданной записи (следующие записи – с номерами по порядку).
+    uint8_t count;     ///< Количество переданных записей (0..EVENTS_PER_READ).
+    uint8_t dropped;   ///< Количество записей, отброшенных из-за переполнения журнала (по модулю 256).
+};
+
+static const uint8_t EVENTS_PER_READ = 3;       ///< Наибольшее количество записей в одном ответе (заголовок и записи – до 32 байт).
+static EventLog<ButtonEvent, 32> buttonEvents;  ///< Журнал событий кнопок (до 32 неподтверждённых записей).
+static volatile uint16_t eventsReadFrom = 0;    ///< Номер первой записи для следующего чтения журнала.
+static_assert(sizeof(EventsHeader) + EVENTS_PER_READ * sizeof(ButtonEvent) <= 32, "Ответ журнала должен помещаться в буфер Wire");
+
+#ifdef SMBUS_ALERT
+static SmbusAlert smbusAlert(I2C1, PB5);    ///< SMBALERT# на PB5 (SMBA модуля I2C1) и ответ на ARA.
+static volatile uint8_t readStatusSequence; ///< Номер снимка buttonStatus, прочитанного ведущим последним.
+static volatile uint8_t readNotifyCount;    ///< Значение ButtonStatus::notifyCount в снимке, прочитанном ведущим последним.
+#endif
+
+#ifdef I2C_TRACE
+/**
+ * @brief Заголовок ответа на чтение журнала транзакций I2C.
+ */
+struct TraceHeader
+{
+    uint16_t count;  ///< Количество записанных транзакций (по модулю 65536).
+    uint16_t stored; ///< Количество доступных записей; запись с номером от последней не меньше stored передаётся нулями.
+};
+
+typedef I2cTrace<32> BusTrace;
+static BusTrace busTrace __attribute__((section(".noinit"))); ///< Журнал транзакций I2C (сохраняется при тёплом сбросе).
+static volatile uint8_t traceReadBack = 0;                     ///< Номер записи журнала от последней для следующего чтения.
+static_assert(sizeof(TraceHeader) + sizeof(BusTrace::Entry) <= 32, "Ответ журнала транзакций должен помещаться в буфер Wire");
+#endif
+
+#ifdef DUAL_ADDRESS
+#ifdef SMBUS_ALERT
+#error "DUAL_ADDRESS и SMBUS_ALERT используют второй собственный адрес (OAR2)"
+#endif
+static const uint8_t I2C_LED_ADDRESS = 0x21;                 ///< Второй адрес слейва: светодиоды без байта команды.
+static I2cSecondAddress ledEndpoint(I2C1, I2C_LED_ADDRESS); ///< Адрес светодиодов (OAR2).
+#endif
+
+/**
+ * @brief Параметры адаптивного устранения дребезга кнопки в том виде, в котором они передаются по I2C.
+ */
+struct DebounceInfo
+{
+    uint32_t effectiveUs;  ///< Рабочая задержка, мкс.
+    uint16_t bounceUs;     ///< Наблюдаемая длительность дребезга (максимум по последним пачкам), мкс.
+    uint16_t observations; ///< Количество наблюдённых пачек дребезга.
+};
+
+/**
+ * @brief Снимок параметров адаптивного устранения дребезга, публикуемый при каждом новом наблюдении.
+ */
+struct DebounceStatus
+{
+    DebounceInfo buttons[2]; ///< [0] – "Громкость -", [1] – "Громкость +".
+};
+
+static SnapshotBuffer<DebounceStatus> debounceStatus; ///< Последний снимок параметров дребезга.
+
+/**
+ * @brief Снимок состояния группы клавиш (матрицы или панели расширения); события – счётчики по индексам клавиш, как в ButtonStatus.
+ */
+template <uint8_t KeyCount>
+struct KeyBankStatus
+{
+    uint32_t pressed;             ///< Текущее состояние клавиш (бит на клавишу).
+    uint8_t shortCount[KeyCount]; ///< Счётчики кратковременных нажатий.
+    uint8_t longCount[KeyCount];  ///< Счётчики длительных нажатий.
+};
 
-static ButtonHandler volPlusButton(BTN_PIN[0], debounceDelay, longPressThreshold);
-static ButtonHandler volMinusButton(BTN_PIN[1], debounceDelay, longPressThreshold);
+#ifdef KEY_MATRIX
+#ifndef KEY_MATRIX_ROWS
+#define KEY_MATRIX_ROWS 4 ///< Количество строк матрицы клавиш (до 6).
+#endif
+static const uint8_t CMD_READ_MATRIX = 0x44;                                   ///< Код команды чтения состояния матрицы клавиш.
+static const uint8_t MATRIX_ROW_PINS[] = {PB12, PB13, PB14, PB15, PB10, PB11}; ///< Пины строк матрицы (используются первые KEY_MATRIX_ROWS).
+static const uint8_t MATRIX_COL_PINS[] = {PB0, PB1, PB8, PB9};                 ///< Пины столбцов матрицы.
+static const uint32_t MATRIX_FRAME_RATE = 1000;                                ///< Частота сканирования полных кадров матрицы, Гц.
+static_assert(KEY_MATRIX_ROWS <= sizeof MATRIX_ROW_PINS, "Недостаточно пинов строк матрицы");
+
+typedef KeyMatrix<KEY_MATRIX_ROWS, sizeof MATRIX_COL_PINS> PanelMatrix;
+static PanelMatrix keyMatrix(MATRIX_ROW_PINS, MATRIX_COL_PINS, debounceDelay, longPressThreshold, false);
+typedef KeyBankStatus<PanelMatrix::KEY_COUNT> MatrixStatus;
+static SnapshotBuffer<MatrixStatus> matrixStatus; ///< Последний согласованный снимок состояния матрицы.
+#endif // KEY_MATRIX
+
+#ifdef SHIFT_EXPANDER
+#ifdef KEY_MATRIX
+#error "SHIFT_EXPANDER (SPI2, PB12–PB15) и KEY_MATRIX используют одни пины"
+#endif
+static const uint8_t CMD_WRITE_EXPANDER = 0x4B; ///< Код команды записи выходов панели расширения.
+static const uint8_t CMD_READ_EXPANDER = 0x4C;  ///< Код команды чтения состояния клавиш панели расширения.
+
+typedef ShiftRegisterPanel<4> ExpanderPanel; ///< 4 x 74HC595 (32 выхода) и 4 x 74HC165 (32 клавиши).
+static ExpanderPanel expander(SPI2, DMA1_Channel4, DMA1_Channel5, PB13, PB14, PB15, PB12, longPressThreshold);
+typedef KeyBankStatus<ExpanderPanel::KEY_COUNT> ExpanderStatus;
+static SnapshotBuffer<ExpanderStatus> expanderStatus; ///< Последний согласованный снимок состояния клавиш панели.
+#endif
+
+#ifdef LED_PATTERN
+#ifdef KEY_MATRIX
+#error "LED_PATTERN и KEY_MATRIX используют TIM4"
+#endif
+static const uint8_t CMD_LED_PATTERN = 0x49;  ///< Код команды загрузки шаблона светодиодов.
+static const uint8_t CMD_LED_PLAYBACK = 0x4A; ///< Код команды управления воспроизведением шаблона.
+static const uint8_t PLAYBACK_STOP = 0;       ///< Действие CMD_LED_PLAYBACK: остановить воспроизведение.
+static const uint8_t PLAYBACK_START = 1;      ///< Действие CMD_LED_PLAYBACK: запустить последний загруженный шаблон.
+static LedPattern ledPattern(TIM4, DMA1_Channel7, LED_PINS, sizeof LED_PINS); ///< Воспроизведение шаблона (TIM4_UP -> DMA1 канал 7).
+#endif
+
+#ifdef ROTARY_ENCODER
+static const uint8_t CMD_READ_ENCODER = 0x45;       ///< Код команды чтения состояния кнопок и приращения энкодера.
+static RotaryEncoder volumeEncoder(TIM1, PA8, PA9); ///< Энкодер громкости на каналах 1 и 2 TIM1.
+#endif
+
+#ifndef SCHEDULER_TICK_RATE
+#define SCHEDULER_TICK_RATE 1000 ///< Частота тиков планировщика, Гц (период опроса кнопок).
+#endif
+static const uint8_t CMD_READ_SCHEDULER = 0x46; ///< Код команды чтения статистики планировщика.
+
+#ifdef COROUTINE_TASKS
+static const uint8_t CMD_READ_COROUTINES = 0x47; ///< Код команды чтения статистики сопрограмм.
+static const uint32_t BUTTON_IDLE_TIMEOUT = 1000; ///< Максимальное ожидание фронта кнопок в покое, тиков.
+static CoScheduler coroutines;                    ///< Планировщик сопрограмм (проход – каждый тик).
+static CoEvent ledUpdate;                         ///< Событие записи нового состояния светодиодов по I2C.
+static_assert(sizeof(CoScheduler::Stats) <= 32, "Статистика сопрограмм должна помещаться в буфер Wire");
+#endif
+#ifdef SMBUS_ALERT
+static void updateAlert();
+#endif
+#ifndef COMMAND_QUEUE_DEPTH
+#define COMMAND_QUEUE_DEPTH 8 ///< Глубина очереди команд I2C (степень двойки).
+#endif
+typedef CommandQueue<COMMAND_QUEUE_DEPTH> I2cCommandQueue;
+static I2cCommandQueue commandQueue; ///< Команды, принятые по I2C и ожидающие выполнения в задаче serviceBus().
+static_assert(sizeof(I2cCommandQueue::Stats) <= 32, "Статистика очереди должна помещаться в буфер Wire");
+static void serviceBus();
+
+#ifdef COROUTINE_TASKS
+static void runCoroutines() { coroutines.run(); }
+static const SchedulerTask schedulerTasks[] = {
+    {runCoroutines, 1, 0}, // Проход планировщика сопрограмм (команды I2C, кнопки, светодиоды) – каждый тик
+};
+#else
+static void scanButtons();
+static const SchedulerTask schedulerTasks[] = {
+    {serviceBus, 1, 0},  // Выполнение команд, принятых по I2C, и сигнал SMBALERT# – каждый тик
+    {scanButtons, 1, 0}, // Опрос кнопок и публикация снимка состояния – каждый тик
+};
+#endif
+typedef TickScheduler<sizeof schedulerTasks / sizeof schedulerTasks[0]> Scheduler;
+static Scheduler scheduler(schedulerTasks, SCHEDULER_TICK_RATE); ///< Планировщик задач (тики от TIM2).
+static_assert(sizeof(Scheduler::Stats) <= 32, "Статистика планировщика должна помещаться в буфер Wire");
+
+/**
+ * @brief Формирует байт событий из счётчиков, изменившихся с момента предыдущего ответа.
+ * @param count Счётчики событий из снимка.
+ * @param reported Значения счётчиков на момент предыдущего ответа (обновляются).
+ * @param mask Учитываемые биты; счётчики остальных битов не сбрасываются.
+ * @return Байт с установленными битами изменившихся счётчиков.
+ */
+template <size_t N>
+static uint32_t takeChangedEvents(const uint8_t (&count)[N], uint8_t (&reported)[N], uint32_t mask = UINT32_MAX)
+{
+    uint32_t events = 0;
+    for (uint8_t bit = 0; bit < N; ++bit)
+        if (count[bit] != reported[bit] && (mask >> bit & 1))
+            events |= 1UL << bit, reported[bit] = count[bit];
+    return events;
+}
+
+/**
+ * @brief Увеличивает счётчики событий, соответствующие установленным битам.
+ * @param count Счётчики событий.
+ * @param events Байт событий.
+ */
+template <typename T, size_t N>
+static void countEvents(T (&count)[N], uint32_t events)
+{
+    for (uint8_t bit = 0; bit < N; ++bit)
+        count[bit] += (events >> bit) & 1;
+}
+
+/**
+ * @brief Выводит состояние светодиодов на пины.
+ */
+static void applyLedState()
+{
+    for (uint8_t i = 0; i < sizeof LED_PINS; ++i)
+        pinMode(LED_PINS[i], OUTPUT), digitalWrite(LED_PINS[i], (ledState & (1 << i)) ? HIGH : LOW);
+}
+
+/**
+ * @brief Обновляет выходы светодиодов: сразу или, при сборке с COROUTINE_TASKS, в задаче ledTask().
+ */
+static void requestLedUpdate()
+{
+#ifdef COROUTINE_TASKS
+    ledUpdate.signal();
+#else
+    applyLedState();
+#endif
+}
+
+/**
+ * @brief Выводит заданное состояние светодиодов, останавливая воспроизведение шаблона.
+ * Само состояние ledState задаёт acceptLedWrite() в прерывании I2C (и setup() при запуске).
+ */
+static void showLedState()
+{
+#ifdef LED_PATTERN
+    ledPattern.stop();
+#endif
+    requestLedUpdate();
+}
+
+/**
+ * @brief Применяет сохраняемую настройку (при записи командой 0x55 и при запуске).
+ * @param key Ключ (SettingKey).
+ * @param value Значение.
+ */
+static void applySetting(uint8_t key, uint16_t value)
+{
+    switch (key)
+    {
+    case SETTING_SUBSCRIPTION:
+        subscribedEvents = value & 0x7F, changeOnly = value & 0x80, subscribedGestures = (value >> 8) & 0x3F;
+        break;
+    case SETTING_LEDS: // Значение уже записано в ledState (acceptLedWrite() или setup())
+        showLedState();
+        break;
+    }
+}
+
+/**
+ * @brief Выполняет принятую по I2C команду (в задаче serviceBus(), вне прерывания).
+ *
+ * Для команды записи светодиодов ожидается два байта: первый — команда (0x40), второй — данные для светодиодов.
+ * При сборке с COROUTINE_TASKS выходы светодиодов обновляет задача ledTask(), а функция лишь сигнализирует ей.
+ * При сборке с LED_PATTERN команда 0x49 загружает шаблон: период кадра в мс (uint16_t, little-endian) и 1..29 масок
+ * кадров; команда 0x4A с байтом действия (0 – стоп, 1 – запуск загруженного шаблона) управляет воспроизведением.
+ * Запись состояния светодиодов (0x40) останавливает воспроизведение шаблона.
+ * Команда 0x4F принимается и по общему вызову (адрес 0x00): [0x4F, светодиоды] – для всех клавиатур,
+ * [0x4F, светодиоды, маска групп] – только если маска пересекается с KEYBOARD_GROUPS; режим чтения не меняется.
+ * При сборке с DUAL_ADDRESS одиночный байт с нулевым битом 6 (запись по адресу светодиодов) задаёт светодиоды;
+ * адрес записи после условия STOP недоступен, поэтому такой байт принимается и по основному адресу.
+ * Команда подписки (0x50) содержит маску битов байта состояния, маску битов байта жестов и байт флагов
+ * (SUBSCRIBE_CHANGE_ONLY); неподписанные биты не передаются в ответах и не попадают в журнал событий.
+ * Команда записи настройки (0x55) содержит ключ и значение (uint16_t, little-endian): настройка применяется сразу,
+ * а во flash записывается позже задачей serviceBus() (см. FlashStore).
+ * Новое состояние светодиодов (0x40, 0x4F, адрес светодиодов, настройка SETTING_LEDS) уже записано в ledState
+ * в прерывании (см. acceptLedWrite()); здесь обновляются только выходы.
+ *
+ * @param frame Байты команды (первый – код команды).
+ * @param size Количество байтов.
+ */
+static void executeCommand(const uint8_t *frame, uint8_t size)
+{
+    uint8_t command = frame[0];
+#ifdef DUAL_ADDRESS
+    if (size == 1 && !(command & 0x40))
+    {
+        showLedState(); // Запись по адресу светодиодов: байт без команды (у всех команд бит 6 установлен)
+        return;
+    }
+#endif
+    switch (command)
+    {
+    case CMD_WRITE_SETTING:
+        if (size >= 4 && settings.write(frame[1], frame[2] | (frame[3] << 8)))
+            applySetting(frame[1], frame[2] | (frame[3] << 8));
+        return;
+#ifdef SHIFT_EXPANDER
+    case CMD_WRITE_EXPANDER:
+        for (uint8_t i = 0; i < 4 && i + 1 < size; ++i)
+            expander.setOutputs(i, frame[i + 1]);
+        return;
+#endif
+#ifdef LED_PATTERN
+    case CMD_LED_PATTERN:
+        if (size >= 4)
+            ledPattern.load(frame + 3, min<uint8_t>(size - 3, LedPattern::MAX_FRAMES), frame[1] | (frame[2] << 8));
+        return;
+    case CMD_LED_PLAYBACK:
+        if (size < 2)
+            return;
+        switch (frame[1])
+        {
+        case PLAYBACK_START:
+            ledPattern.start();
+            break;
+        case PLAYBACK_STOP: // Возврат к состоянию, заданному командой 0x40
+            ledPattern.stop();
+            requestLedUpdate();
+            break;
+        }
+        return;
+#endif
+    case CMD_SUBSCRIBE:
+        if (size >= 4)
+        {
+            subscribedEvents = frame[1] & 0x7F;
+            subscribedGestures = frame[2] & 0x3F;
+            changeOnly = frame[3] & SUBSCRIBE_CHANGE_ONLY;
+        }
+        return;
+    case CMD_BROADCAST_LED: // Общий вызов: одна транзакция для всех клавиатур на шине
+        if (size < 3 || (frame[2] & KEYBOARD_GROUPS))
+            showLedState();
+        return;
+    case CMD_WRITE_LED:
+        showLedState();
+        return;
+    }
+}
+
+/**
+ * @brief Проверяет команду, не выполненную selectRead(), перед постановкой в очередь (в прерывании I2C).
+ * Команда должна иметь известный код и не меньше байтов данных, чем требует executeCommand().
+ * @param frame Байты команды (первый – код команды).
+ * @param size Количество байтов.
+ * @return true, если команду нужно выполнить.
+ */
+static bool isWellFormed(const uint8_t *frame, uint8_t size)
+{
+    switch (frame[0])
+    {
+    case CMD_WRITE_LED:
+    case CMD_BROADCAST_LED:
+        return size >= 2;
+    case CMD_WRITE_SETTING:
+        return size >= 4 && frame[1] < SETTING_COUNT;
+    case CMD_SUBSCRIBE:
+        return size >= 4;
+#ifdef SHIFT_EXPANDER
+    case CMD_WRITE_EXPANDER:
+        return size >= 2;
+#endif
+#ifdef LED_PATTERN
+    case CMD_LED_PATTERN:
+        return size >= 4;
+    case CMD_LED_PLAYBACK:
+        return size >= 2;
+#endif
+    default:
+#ifdef DUAL_ADDRESS
+        return size == 1 && !(frame[0] & 0x40); // Запись по адресу светодиодов
+#else
+        return false;
+#endif
+    }
+}
+
+/**
+ * @brief Выбирает ответ на следующую операцию чтения по принятой команде (в прерывании I2C).
+ *
+ * Выбор должен действовать до выполнения очереди: при чтении с повторным START ответ формируется сразу после записи.
+ * Поэтому в прерывании разбираются только команды выбора чтения (и состояние светодиодов команды 0x40 и записи
+ * светодиодов командой 0x40) и подтверждение журнала событий (см. acknowledgeEvents());
+ * остальное выполняет executeCommand().
+ * Команды выбора чтения светодиодов (0x51), временных меток (0x42), жестов (0x43), матрицы клавиш (0x44), энкодера (0x45)
+ * и статистики (0x46, 0x47, 0x52, 0x54, 0x57) состоят из одного байта. Команда чтения журнала событий (0x4D) может содержать
+ * номер первой запрашиваемой записи (uint16_t, little-endian), команда чтения журнала транзакций (0x53) – номер
+ * записи от последней (uint8_t), команда чтения настройки (0x56) – ключ (uint8_t). Если бит [7] данных команды 0x40 установлен,
+ * следующая операция чтения вернёт состояние светодиодов.
+ *
+ * @param frame Байты команды (первый – код команды).
+ * @param size Количество байтов.
+ * @return true, если команда полностью выполнена и не требует постановки в очередь.
+ */
+static bool selectRead(const uint8_t *frame, uint8_t size)
+{
+    uint8_t mode;
+    switch (frame[0])
+    {
+    case CMD_READ_LED:
+        mode = READ_LED;
+        break;
+    case CMD_READ_TIMING:
+        mode = READ_TIMING;
+        break;
+    case CMD_READ_GESTURES:
+        mode = READ_GESTURES;
+        break;
+    case CMD_READ_DEBOUNCE:
+        mode = READ_DEBOUNCE;
+        break;
+    case CMD_READ_EVENTS:
+        eventsReadFrom = size >= 3 ? frame[1] | (frame[2] << 8) : buttonEvents.oldestSequence(); // Без номера – с самой старой записи
+        mode = READ_EVENTS;
+        break;
+#ifdef SHIFT_EXPANDER
+    case CMD_READ_EXPANDER:
+        mode = READ_EXPANDER;
+        break;
+#endif
+#ifdef KEY_MATRIX
+    case CMD_READ_MATRIX:
+        mode = READ_MATRIX;
+        break;
+#endif
+#ifdef ROTARY_ENCODER
+    case CMD_READ_ENCODER:
+        mode = READ_ENCODER;
+        break;
+#endif
+    case CMD_READ_SCHEDULER:
+        mode = READ_SCHEDULER;
+        break;
+#ifdef COROUTINE_TASKS
+    case CMD_READ_COROUTINES:
+        mode = READ_COROUTINES;
+        break;
+#endif
+    case CMD_READ_QUEUE:
+        mode = READ_QUEUE;
+        break;
+    case CMD_READ_HEALTH:
+        mode = READ_HEALTH;
+        break;
+    case CMD_READ_SETTING:
+        settingReadKey = size >= 2 ? frame[1] : 0;
+        mode = READ_SETTING;
+        break;
+    case CMD_READ_STORE:
+        mode = READ_STORE;
+        break;
+#ifdef I2C_TRACE
+    case CMD_READ_TRACE:
+        traceReadBack = size >= 2 ? frame[1] : 0; // Без номера – последняя запись
+        mode = READ_TRACE;
+        break;
+#endif
+    case CMD_WRITE_LED:
+        if (size >= 2)
+            readMode = (frame[1] & 0x80) ? READ_LED : READ_BUTTONS;
+        return false; // Состояние светодиодов задаёт acceptLedWrite() после постановки команды в очередь
+    default:
+        return false;
+    }
+    readMode = mode;
+    return true;
+}
+
+/**
+ * @brief Записывает в ledState состояние светодиодов из команды, поставленной в очередь (в прерывании I2C).
+ *
+ * Прерывание – единственный писатель ledState во время работы: чтение светодиодов сразу после записи (0x40 с битом 7,
+ * 0x51, адрес светодиодов) возвращает новое состояние, а выполнение команды в очереди лишь выводит его
+ * (см. showLedState()) и не перезаписывает более позднюю запись. Отброшенная при заполненной очереди команда
+ * состояние не меняет.
+ *
+ * @param frame Байты команды (первый – код команды), прошедшей isWellFormed().
+ * @param size Количество байтов.
+ */
+static void acceptLedWrite(const uint8_t *frame, uint8_t size)
+{
+    switch (frame[0])
+    {
+    case CMD_WRITE_LED:
+        ledState = frame[1] & 0x3F;
+        break;
+    case CMD_BROADCAST_LED:
+        if (size < 3 || (frame[2] & KEYBOARD_GROUPS))
+            ledState = frame[1] & 0x3F;
+        break;
+    case CMD_WRITE_SETTING:
+        if (frame[1] == SETTING_LEDS)
+            ledState = frame[2] & 0x3F;
+        break;
+#ifdef DUAL_ADDRESS
+    default:
+        if (size == 1 && !(frame[0] & 0x40))
+            ledState = frame[0] & 0x3F;
+        break;
+#endif
+    }
+}
+
+/**
+ * @brief Выполняет команду подтверждения записей журнала событий (0x4E) в прерывании I2C.
+ *
+ * Команда содержит номер последней обработанной записи журнала (uint16_t, little-endian): она и все предыдущие
+ * удаляются. Подтверждение выполняется сразу, как и выбор чтения 0x4D: иначе чтение, следующее за подтверждением
+ * до выполнения очереди, вернуло бы уже подтверждённые записи.
+ *
+ * @param frame Байты команды (первый – код команды).
+ * @param size Количество байтов.
+ * @return true, если команда выполнена; команда с неполным номером отклоняется isWellFormed().
+ */
+static bool acknowledgeEvents(const uint8_t *frame, uint8_t size)
+{
+    if (frame[0] != CMD_ACK_EVENTS || size < 3)
+        return false;
+    buttonEvents.acknowledge(frame[1] | (frame[2] << 8));
+    return true;
+}
+
+/**
+ * @brief Добавляет транзакцию в журнал транзакций I2C (при сборке с I2C_TRACE). Вызывается из прерывания I2C.
+ * @param status Результат транзакции (I2cTraceStatus).
+ * @param bytes Байты транзакции (для чтения – выбранный ответ).
+ * @param length Количество байтов.
+ */
+static void traceTransaction(uint8_t status, const uint8_t *bytes, uint8_t length)
+{
+#ifdef I2C_TRACE
+    busTrace.record(status, bytes, length);
+#else
+    (void)status, (void)bytes, (void)length;
+#endif
+}
 
 /**
  * @brief Обработчик приема данных по I2C.
  *
- * Функция вызывается при получении данных от ведущего по шине I2C.
- * Ожидается два байта: первый — команда (0x40), второй — данные для светодиодов.
- * Если бит [7] во втором байте установлен, то следующая операция чтения вернет состояние светодиодов.
+ * Функция вызывается при получении данных от ведущего по шине I2C. Принятые байты копируются в очередь команд,
+ * которую выполняет задача serviceBus() (см. executeCommand()); в прерывании лишь выбирается ответ
+ * на следующую операцию чтения (см. selectRead()) и подтверждаются записи журнала событий (см. acknowledgeEvents()). Команда с неизвестным кодом или неполными данными отклоняется
+ * (см. isWellFormed()) и учитывается в счётчиках работоспособности. Если очередь заполнена, команда отбрасывается.
+ * Худшее время обработчика и заполнение очереди читаются командой 0x52. При сборке с I2C_TRACE транзакция
+ * (кроме чтения самого журнала) записывается в журнал транзакций: не более I2cTrace::MAX_BYTES байтов.
  *
  * @param received_bytes Количество полученных байтов.
  */
 void receiveEvent(int received_bytes)
 {
-    if (received_bytes < 2 || Wire.read() != CMD_WRITE_LED)
-        return; // Если получено меньше двух байтов или команда не для записи светодиодов, выходим
+    uint32_t start = DWT->CYCCNT;
+    ++busWrites, lastBusActivityMs = millis();
+    if (received_bytes >= 1)
+    {
+        I2cCommandQueue::Frame overflow, *frame = commandQueue.claim();
+        frame = frame ? frame : &overflow; // При заполненной очереди команда всё равно разбирается для выбора чтения
+        for (frame->size = 0; Wire.available() && frame->size < sizeof frame->data;)
+            frame->data[frame->size++] = Wire.read();
+        uint8_t status;
+        if (selectRead(frame->data, frame->size) || acknowledgeEvents(frame->data, frame->size))
+            status = TRACE_WRITE_SELECT; // Команда выбора чтения или подтверждения журнала выполнена в прерывании
+        else if (!isWellFormed(frame->data, frame->size))
+            ++malformedFrames, status = TRACE_WRITE_MALFORMED;
+        else if (frame != &overflow)
+            acceptLedWrite(frame->data, frame->size), commandQueue.commit(), status = TRACE_WRITE_QUEUED;
+        else
+            commandQueue.drop(), status = TRACE_WRITE_DROPPED;
+        if (frame->data[0] != CMD_READ_TRACE) // Чтение журнала не вытесняет из него записи
+            traceTransaction(status, frame->data, frame->size);
+    }
+    else
+        traceTransaction(TRACE_WRITE_EMPTY, nullptr, 0);
+    commandQueue.recordIsrCycles(DWT->CYCCNT - start);
+}
 
-    uint8_t data = Wire.read();
-    ledState = data & 0x3F;
-    lastCommandReadLED = (data & 0x80);
+/**
+ * @brief Проверяет, что шина I2C свободна: нет начатой транзакции, очередь команд пуста и с последней транзакции
+ * прошло не меньше FLASH_ERASE_IDLE_MS. Только тогда хранилище стирает страницу: на ~20 мс стирания останавливаются
+ * и обработчики прерываний, и ведущий, обратившийся в это время, ждёт на растянутом SCL.
+ */
+static bool isBusIdle()
+{
+    return !(I2C1->SR2 & I2C_SR2_BUSY) && !commandQueue.front() && millis() - lastBusActivityMs >= FLASH_ERASE_IDLE_MS;
+}
 
-    for (uint8_t i = 0; i < sizeof LED_PINS; ++i) // Обновление выходов для светодиодов
-        pinMode(LED_PINS[i], OUTPUT), digitalWrite(LED_PINS[i], (ledState & (1 << i)) ? HIGH : LOW);
+/**
+ * @brief Задача планировщика (или сопрограммы busTask()): выполняет команды, принятые по I2C с предыдущего тика,
+ * выполняет одну отложенную операцию хранилища настроек (стирание – только при свободной шине, см. isBusIdle())
+ * и обновляет сигнал SMBALERT#.
+ */
+static void serviceBus()
+{
+    while (const I2cCommandQueue::Frame *frame = commandQueue.front())
+        executeCommand(frame->data, frame->size), commandQueue.pop();
+    settings.service(isBusIdle());
+#ifdef SMBUS_ALERT
+    updateAlert();
+#endif
+}
+
+/**
+ * @brief Передаёт 12 байт масок группы клавиш: нажатые сейчас, кратковременные и длительные нажатия с предыдущего ответа.
+ * @param snapshot Снимок состояния группы клавиш.
+ * @param reportedShort Значения счётчиков кратковременных нажатий на момент предыдущего ответа (обновляются).
+ * @param reportedLong Значения счётчиков длительных нажатий на момент предыдущего ответа (обновляются).
+ */
+template <uint8_t KeyCount>
+static void writeKeyMasks(const SnapshotBuffer<KeyBankStatus<KeyCount>> &snapshot, uint8_t (&reportedShort)[KeyCount], uint8_t (&reportedLong)[KeyCount])
+{
+    KeyBankStatus<KeyCount> status;
+    snapshot.read(status);
+    uint32_t masks[3] = {status.pressed, takeChangedEvents(status.shortCount, reportedShort),
+                         takeChangedEvents(status.longCount, reportedLong)};
+    Wire.write((const uint8_t *)masks, sizeof masks);
+}
+
+/**
+ * @brief Отмечает, что ведущий прочитал снимок состояния кнопок (для сигнала SMBALERT#).
+ * @param sequence Номер прочитанного снимка.
+ * @param status Прочитанный снимок.
+ */
+static void markStatusRead(uint8_t sequence, const ButtonStatus &status)
+{
+#ifdef SMBUS_ALERT
+    readStatusSequence = sequence, readNotifyCount = status.notifyCount;
+    smbusAlert.markServiced(); // Ведущий нашёл клавиатуру – снова отвечать на ARA
+#else
+    (void)sequence, (void)status;
+#endif
+}
+
+/**
+ * @brief Формирует байт состояния кнопок из последнего снимка с учётом подписки.
+ * События – счётчики подписанных битов, изменившиеся с момента предыдущего формирования байта.
+ * @return Байт состояния кнопок.
+ */
+static uint8_t takeButtonState()
+{
+    static uint8_t reportedCount[8]; // Значения счётчиков событий на момент предыдущего ответа
+    ButtonStatus status;
+    markStatusRead(buttonStatus.read(status), status);
+    uint8_t mask = subscribedEvents;
+    return (status.pressed & mask) | takeChangedEvents(status.eventCount, reportedCount, mask);
 }
 
 /**
@@ -60,26 +910,172 @@ void receiveEvent(int received_bytes)
  *
  * Функция вызывается, когда ведущий запрашивает данные.
  * Если был запрошен режим чтения состояния светодиодов, возвращается состояние светодиодов с установленным битом 7.
+ * Если была получена команда 0x42, возвращается 28 байт (little-endian): текущее время в мс (uint32_t)
+ * и PressTiming для кнопок "Громкость -" и "Громкость +".
+ * Если была получена команда 0x43, возвращается байт жестов: биты [2:0] – завершённые с прошлого чтения серии
+ * из 1, 2 и 3 касаний кнопки "Громкость -", биты [5:3] – то же для кнопки "Громкость +".
+ * Если была получена команда 0x44, возвращается 12 байт (little-endian, uint32_t): маска нажатых клавиш матрицы,
+ * маски клавиш с кратковременным и с длительным нажатием с момента предыдущего чтения матрицы.
+ * Если была получена команда 0x45, возвращается байт состояния кнопок и приращение энкодера (int8_t, щелчки)
+ * с момента предыдущего чтения энкодера.
+ * Если была получена команда 0x46, возвращается статистика планировщика (TickScheduler::Stats).
+ * Если была получена команда 0x47, возвращается статистика сопрограмм (CoScheduler::Stats).
+ * Если была получена команда 0x48, возвращается 16 байт: DebounceInfo для кнопок "Громкость -" и "Громкость +".
+ * При сборке с DUAL_ADDRESS чтение по адресу светодиодов возвращает их состояние (биты [5:0]) и не сбрасывает режим чтения.
+ * При сборке с SMBUS_ALERT чтение по адресу ARA (0x0C) возвращает собственный адрес в битах [7:1] и не сбрасывает режим чтения;
+ * до следующего чтения событий (markStatusRead()) адрес ARA не подтверждается.
+ * Если была получена команда 0x4D, возвращается EventsHeader и до EVENTS_PER_READ записей ButtonEvent,
+ * начиная с запрошенной (или самой старой) неподтверждённой записи; журнал при этом не изменяется.
+ * Если была получена команда 0x53 (сборка с I2C_TRACE), возвращается TraceHeader и запись журнала транзакций I2C.
+ * Если была получена команда 0x54, возвращаются счётчики работоспособности (HealthStats).
+ * Если была получена команда 0x56, возвращается значение настройки (SettingValue), команда 0x57 – статистика хранилища.
  * В противном случае возвращается состояние кнопок с информацией о кратковременных и длительных нажатиях.
+ * Состояние кнопок берётся из последнего снимка, опубликованного основным циклом, поэтому ответ
+ * всегда согласован и формируется за постоянное время.
  */
 void requestEvent()
 {
-    uint8_t response = 0;
-    if (lastCommandReadLED) // Если активирован режим чтения светодиодов, возвращаем состояние светодиодов
+    ++busReads, lastBusActivityMs = millis();
+#ifdef DUAL_ADDRESS
+    if (ledEndpoint.isAddressed())
+    {
+        Wire.write(ledState);
+        return traceTransaction(TRACE_READ_SECOND, nullptr, 0);
+    }
+#endif
+#ifdef SMBUS_ALERT
+    if (smbusAlert.isAlertResponse())
+        return smbusAlert.respond(I2C_SLAVE_ADDRESS), traceTransaction(TRACE_READ_ALERT, nullptr, 0);
+#endif
+    uint8_t mode = readMode;
+    readMode = READ_BUTTONS; // Режим, выбранный командой, действует на одну операцию чтения
+    if (mode != READ_TRACE)
+        traceTransaction(TRACE_READ, &mode, 1);
+    switch (mode)
+    {
+    case READ_LED: // Состояние светодиодов с установленным битом 7
+        Wire.write(ledState | 0x80);
+        break;
+    case READ_TIMING: // Временные метки нажатий из последнего снимка
+    {
+        ButtonStatus status;
+        buttonStatus.read(status);
+        uint32_t now = millis();
+        Wire.write((const uint8_t *)&now, sizeof now);
+        Wire.write((const uint8_t *)status.timing, sizeof status.timing);
+        break;
+    }
+    case READ_GESTURES: // Серии касаний, завершённые с момента предыдущего чтения жестов
+    {
+        static uint8_t reportedGestures[8]; // Значения счётчиков жестов на момент предыдущего ответа
+        ButtonStatus status;
+        buttonStatus.read(status);
+        Wire.write(takeChangedEvents(status.gestureCount, reportedGestures, subscribedGestures));
+        break;
+    }
+#ifdef KEY_MATRIX
+    case READ_MATRIX: // Маски клавиш матрицы: нажатые сейчас, кратковременные и длительные нажатия
+    {
+        static uint8_t reportedShort[PanelMatrix::KEY_COUNT], reportedLong[PanelMatrix::KEY_COUNT];
+        writeKeyMasks(matrixStatus, reportedShort, reportedLong);
+        break;
+    }
+#endif
+#ifdef SHIFT_EXPANDER
+    case READ_EXPANDER: // Маски клавиш панели расширения
+    {
+        static uint8_t reportedShort[ExpanderPanel::KEY_COUNT], reportedLong[ExpanderPanel::KEY_COUNT];
+        writeKeyMasks(expanderStatus, reportedShort, reportedLong);
+        break;
+    }
+#endif
+#ifdef ROTARY_ENCODER
+    case READ_ENCODER: // Байт состояния кнопок и приращение энкодера в щелчках
+        Wire.write(takeButtonState());
+        Wire.write((uint8_t)volumeEncoder.takeDetents());
+        break;
+#endif
+    case READ_SCHEDULER: // Статистика планировщика за последнюю секунду
+    {
+        Scheduler::Stats stats;
+        scheduler.readStats(stats);
+        Wire.write((const uint8_t *)&stats, sizeof stats);
+        break;
+    }
+#ifdef COROUTINE_TASKS
+    case READ_COROUTINES: // Статистика сопрограмм за последнюю секунду
+    {
+        CoScheduler::Stats stats;
+        coroutines.readStats(stats);
+        Wire.write((const uint8_t *)&stats, sizeof stats);
+        break;
+    }
+#endif
+    case READ_DEBOUNCE: // Параметры адаптивного устранения дребезга
+    {
+        DebounceStatus status;
+        debounceStatus.read(status);
+        Wire.write((const uint8_t *)status.buttons, sizeof status.buttons);
+        break;
+    }
+    case READ_QUEUE: // Статистика очереди команд
     {
-        response = ledState | 0x80; // Устанавливаем бит 7
-        lastCommandReadLED = false; // Сброс флага после чтения
+        I2cCommandQueue::Stats stats;
+        commandQueue.readStats(stats);
+        Wire.write((const uint8_t *)&stats, sizeof stats);
+        break;
     }
-    else // Формирование байта состояния кнопок:
+    case READ_SETTING: // Значение сохраняемой настройки из копии в RAM
     {
-        response |= (volMinusButton.isPressedNow() << 0) | // "Громкость -": бит 0 – текущее состояние,
-                    (volMinusButton.isShortPress() << 1) | //                бит 1 – кратковременное нажатие,
-                    (volMinusButton.isLongPress() << 2);   //                бит 2 – длительное нажатие
-        response |= (volPlusButton.isPressedNow() << 3) |  // "Громкость +": бит 3 – текущее состояние,
-                    (volPlusButton.isShortPress() << 4) |  //                бит 4 – кратковременное нажатие,
-                    (volPlusButton.isLongPress() << 5);    //                бит 5 – длительное нажатие
+        SettingValue setting = {0, settingReadKey, 0};
+        setting.flags = settings.read(setting.key, setting.value) | settings.isPending(setting.key) << 1;
+        Wire.write((const uint8_t *)&setting, sizeof setting);
+        break;
+    }
+    case READ_STORE: // Статистика хранилища настроек
+    {
+        SettingsStore::Stats stats;
+        settings.readStats(stats);
+        Wire.write((const uint8_t *)&stats, sizeof stats);
+        break;
+    }
+    case READ_HEALTH: // Счётчики работоспособности
+    {
+        ButtonStatus status;
+        buttonStatus.read(status);
+        HealthStats health = {uptimeSeconds(), busWrites, busReads, scheduler.maxLatencyCycles(), {}, malformedFrames, watchdog.resetCount(),
+                              settings.maxStallUs()};
+        memcpy(health.presses, status.pressCount, sizeof health.presses);
+        Wire.write((const uint8_t *)&health, sizeof health);
+        break;
+    }
+#ifdef I2C_TRACE
+    case READ_TRACE: // Запись журнала транзакций I2C (нули, если записи нет)
+    {
+        TraceHeader header = {busTrace.count(), busTrace.stored()};
+        BusTrace::Entry entry = {};
+        busTrace.read(traceReadBack, entry);
+        Wire.write((const uint8_t *)&header, sizeof header);
+        Wire.write((const uint8_t *)&entry, sizeof entry);
+        break;
+    }
+#endif
+    case READ_EVENTS: // Неподтверждённые записи журнала событий (повторное чтение вернёт их же)
+    {
+        ButtonEvent entries[EVENTS_PER_READ];
+        EventsHeader header;
+        header.count = buttonEvents.read(eventsReadFrom, entries, EVENTS_PER_READ, header.firstSeq);
+        header.dropped = buttonEvents.droppedCount();
+        ButtonStatus status;
+        markStatusRead(buttonStatus.read(status), status);
+        Wire.write((const uint8_t *)&header, sizeof header);
+        Wire.write((const uint8_t *)entries, header.count * sizeof(ButtonEvent));
+        break;
+    }
+    default: // Байт состояния кнопок
+        Wire.write(takeButtonState());
+        break;
     }
-    Wire.write(response);
 }
 
 /**
@@ -94,25 +1090,277 @@ void requestEvent()
  */
 uint64_t get_tick(void)
 {
-    static uint32_t overflow = 0;
-    static uint32_t lastMicros = 0;
     uint32_t currentMicros = micros();
-    overflow += (currentMicros < lastMicros);
-    return ((uint64_t)overflow << 32) | (lastMicros = currentMicros);
+    __disable_irq(); // Пара tickOverflow, tickLastMicros согласована для uptimeSeconds() в обработчике запроса I2C
+    uint32_t overflow = tickOverflow + (currentMicros < tickLastMicros);
+    tickOverflow = overflow;
+    tickLastMicros = currentMicros;
+    __enable_irq();
+    return ((uint64_t)overflow << 32) | currentMicros;
 }
 
+/**
+ * @brief Собирает события клавиш группы (матрицы или панели расширения) и публикует снимок при изменениях.
+ * @param panel Группа клавиш с обработанным кадром (key(i) – обработчик клавиши).
+ * @param status Накапливаемое состояние группы.
+ * @param snapshot Снимок для обработчика запроса I2C.
+ */
+template <class Panel, uint8_t KeyCount>
+static void publishKeys(Panel &panel, KeyBankStatus<KeyCount> &status, SnapshotBuffer<KeyBankStatus<KeyCount>> &snapshot)
+{
+    uint32_t pressed = 0, shortPresses = 0, longPresses = 0;
+    for (uint8_t i = 0; i < KeyCount; ++i)
+    {
+        auto &key = panel.key(i);
+        pressed |= (uint32_t)key.isPressedNow() << i;
+        shortPresses |= (uint32_t)key.isShortPress() << i;
+        longPresses |= (uint32_t)key.isLongPress() << i;
+    }
+    if (pressed == status.pressed && !shortPresses && !longPresses)
+        return;
+
+    status.pressed = pressed;
+    countEvents(status.shortCount, shortPresses);
+    countEvents(status.longCount, longPresses);
+    snapshot.publish(status);
+}
+
+#ifdef KEY_MATRIX
+/**
+ * @brief Обрабатывает последний кадр матрицы клавиш и публикует снимок её состояния при изменениях.
+ * @param ticks Текущее время в микросекундах.
+ */
+static void updateMatrix(uint64_t ticks)
+{
+    static MatrixStatus status = {};
+    keyMatrix.updateState(ticks);
+    publishKeys(keyMatrix, status, matrixStatus);
+}
+#endif
+
+#ifdef SHIFT_EXPANDER
+/**
+ * @brief Обновляет панель расширения (выходы и кадр клавиш) и публикует снимок состояния клавиш при изменениях.
+ * @param ticks Текущее время в микросекундах.
+ */
+static void updateExpander(uint64_t ticks)
+{
+    static ExpanderStatus status = {};
+    expander.refresh();
+    expander.updateState(ticks);
+    publishKeys(expander, status, expanderStatus);
+}
+#endif
+
+#ifdef COROUTINE_TASKS
+static void scanButtons();
+
+/**
+ * @brief Сопрограмма выполнения команд, принятых по I2C (см. serviceBus()), – каждый тик.
+ * Запускается первой, поэтому команды тика выполняются до опроса кнопок и обновления светодиодов.
+ */
+static CoTask busTask()
+{
+    for (;;)
+    {
+        serviceBus();
+        co_await CoSleep(1);
+    }
+}
+
+/**
+ * @brief Сопрограмма опроса кнопок: каждый тик, а в покое – до фронта на пинах кнопок (не дольше BUTTON_IDLE_TIMEOUT,
+ * чтобы get_tick() не пропускал переполнения micros()).
+ */
+static CoTask buttonTask()
+{
+    for (;;)
+    {
+        scanButtons();
+#if !defined(KEY_MATRIX) && !defined(SHIFT_EXPANDER)
+        if (volPlusButton.isIdle() && volMinusButton.isIdle())
+        {
+            co_await CoPinChange(GPIOA, VolPlusButton::PIN_MASK | VolMinusButton::PIN_MASK, BUTTON_IDLE_TIMEOUT);
+            continue;
+        }
+#endif
+        co_await CoSleep(1);
+    }
+}
+
+/**
+ * @brief Сопрограмма обновления светодиодов по записи команды 0x40.
+ */
+static CoTask ledTask()
+{
+    for (;;)
+    {
+        co_await ledUpdate;
+        applyLedState();
+    }
+}
+
+/**
+ * @brief Сообщает в Serial об ошибке запуска и останавливает прошивку: сторожевой таймер перезагрузит плату.
+ * @param message Текст ошибки.
+ */
+[[noreturn]] static void haltOnStartupError(const char *message)
+{
+    Serial.begin(115200);
+    Serial.println(message);
+    Serial.flush();
+    for (;;)
+        ;
+}
+#endif
+
 void setup()
 {
-    Wire.begin(I2C_SLAVE_ADDRESS); // I2C-1 standard pins: PB7(sda) PB6(scl)
+    uint8_t resetFlags = RCC->CSR >> 24;
+    RCC->CSR |= RCC_CSR_RMVF; // Флаги причины сброса накапливаются до явного сброса
+    watchdog.begin(WATCHDOG_TIMEOUT_MS, resetFlags);
+#ifdef I2C_TRACE
+    busTrace.begin(resetFlags);
+#endif
+    settings.begin(); // Форматирование при первом запуске стирает страницы – до подключения к шине
+    uint16_t leds;
+    if (settings.read(SETTING_LEDS, leds)) // Дальше ledState задаёт только прерывание I2C (acceptLedWrite())
+        ledState = leds & 0x3F;
+    Wire.begin(I2C_SLAVE_ADDRESS, true); // I2C-1 standard pins: PB7(sda) PB6(scl); приём общего вызова (0x00)
     Wire.onReceive(receiveEvent);
     Wire.onRequest(requestEvent);
+    volPlusButton.begin();
+    volMinusButton.begin();
+#ifdef EDGE_CAPTURE
+    buttonCapture.begin();
+#endif
+#ifdef KEY_MATRIX
+    keyMatrix.begin(TIM4, MATRIX_FRAME_RATE);
+#endif
+#ifdef ROTARY_ENCODER
+    volumeEncoder.begin();
+#endif
+#ifdef LED_PATTERN
+    ledPattern.begin();
+#endif
+#ifdef SHIFT_EXPANDER
+    expander.begin();
+#endif
+#ifdef SMBUS_ALERT
+    smbusAlert.begin(Wire.getHandle());
+#endif
+#ifdef DUAL_ADDRESS
+    ledEndpoint.begin(Wire.getHandle());
+#endif
+#ifdef COROUTINE_TASKS
+    coroutines.begin();
+    if (!coroutines.spawn(busTask()) || !coroutines.spawn(buttonTask()) || !coroutines.spawn(ledTask()))
+        haltOnStartupError("ОШИБКА: кадр сопрограммы не помещается в пул (COROUTINE_MAX_TASKS, COROUTINE_FRAME_SIZE)");
+#endif
+    for (uint8_t key = SETTING_SUBSCRIPTION; key < SETTING_USER; ++key) // Настройки применяются до выполнения команд ведущего
+    {
+        uint16_t value;
+        if (settings.read(key, value))
+            applySetting(key, value);
+    }
+    scheduler.begin(TIM2);
 }
 
-void loop()
+/**
+ * @brief Публикует параметры адаптивного устранения дребезга, если наблюдалась новая пачка дребезга.
+ */
+static void publishDebounce()
+{
+    static DebounceStatus status = {};
+    const VolumeDebounce &minus = volMinusButton.debouncer(), &plus = volPlusButton.debouncer();
+    if (status.buttons[0].effectiveUs && minus.observations() == status.buttons[0].observations &&
+        plus.observations() == status.buttons[1].observations)
+        return; // Публикуем при запуске и после каждого нового наблюдения
+    status.buttons[0] = {minus.effectiveDelay(debounceDelay), minus.bounceEstimate(), minus.observations()};
+    status.buttons[1] = {plus.effectiveDelay(debounceDelay), plus.bounceEstimate(), plus.observations()};
+    debounceStatus.publish(status);
+}
+
+/**
+ * @brief Задача планировщика (или сопрограммы buttonTask()): опрос кнопок (и матрицы), распознавание аккорда и публикация снимка состояния.
+ */
+static void scanButtons()
 {
+    static ButtonStatus status = {};
     uint64_t ticks = get_tick();
+#ifdef EDGE_CAPTURE
+    EdgeCapture::Edge edge;
+    while (buttonCapture.takeEdge(edge))
+    {
+        uint64_t edgeTicks = ticks - (uint32_t)((uint32_t)ticks - edge.micros); // Метка micros() в шкале get_tick()
+        if (edge.channel == 0)
+            volPlusButton.updateState(edge.level, edgeTicks);
+        else
+            volMinusButton.updateState(edge.level, edgeTicks);
+    }
+    volPlusButton.updateState(buttonCapture.level(0), ticks);
+    volMinusButton.updateState(buttonCapture.level(1), ticks);
+#else
     volPlusButton.updateState(ticks);
     volMinusButton.updateState(ticks);
+#endif
+    volumeChord.updateState();
+#ifdef KEY_MATRIX
+    updateMatrix(ticks);
+#endif
+#ifdef SHIFT_EXPANDER
+    updateExpander(ticks);
+#endif
+
+    publishDebounce();
+
+    uint8_t pressed = (volMinusButton.isPressedNow() << 0) | // "Громкость -": бит 0 – текущее состояние,
+                      (volPlusButton.isPressedNow() << 3);   // "Громкость +": бит 3 – текущее состояние
+    uint8_t events = (volMinusButton.isShortPress() << 1) |  // "Громкость -": бит 1 – кратковременное нажатие,
+                     (volMinusButton.isLongPress() << 2) |   //                бит 2 – длительное нажатие
+                     (volPlusButton.isShortPress() << 4) |   // "Громкость +": бит 4 – кратковременное нажатие,
+                     (volPlusButton.isLongPress() << 5) |    //                бит 5 – длительное нажатие
+                     (volumeChord.isChord() << 6);           // Бит 6 – одновременное нажатие обеих кнопок
+    uint8_t minusTaps = volMinusButton.takeTapCount(), plusTaps = volPlusButton.takeTapCount();
+    uint8_t gestures = (minusTaps ? 1 << (minusTaps - 1) : 0) | // "Громкость -": биты 0–2 – серия из 1..3 касаний
+                       (plusTaps ? 1 << (plusTaps + 2) : 0);     // "Громкость +": биты 3–5 – серия из 1..3 касаний
+    if (pressed == status.pressed && !events && !gestures)
+        return; // Публикуем снимок только при изменении состояния
+
+    uint8_t notifyEvents = ((pressed ^ status.pressed) | events) & subscribedEvents, notifyGestures = gestures & subscribedGestures;
+    if (notifyEvents || notifyGestures) // В журнал и в готовность попадают только подписанные изменения
+    {
+        buttonEvents.push({(uint32_t)(ticks / 1000), pressed, (uint8_t)(notifyEvents & ~0x09), notifyGestures, 0});
+        ++status.notifyCount;
+    }
+    status.pressed = pressed;
+    status.timing[0] = {volMinusButton.pressStartMs(), volMinusButton.releaseMs(), volMinusButton.pressDurationMs()};
+    status.timing[1] = {volPlusButton.pressStartMs(), volPlusButton.releaseMs(), volPlusButton.pressDurationMs()};
+    countEvents(status.eventCount, events);
+    countEvents(status.gestureCount, gestures);
+    countEvents(status.pressCount, (events >> 1 & 0x03) | (events >> 2 & 0x1C)); // Биты 1, 2, 4, 5, 6 – подряд
+    buttonStatus.publish(status);
+}
+
+#ifdef SMBUS_ALERT
+/**
+ * @brief Удерживает SMBALERT# (вызывается задачей serviceBus()), пока ведущий не прочитал последний снимок состояния кнопок
+ * (командой 0x41, 0x45 или 0x4D) или в журнале есть неподтверждённые записи.
+ * В режиме "только изменения" учитываются лишь снимки с изменениями подписанных типов.
+ */
+static void updateAlert()
+{
+    ButtonStatus status;
+    uint8_t sequence = buttonStatus.read(status);
+    bool unread = changeOnly ? status.notifyCount != readNotifyCount : sequence != readStatusSequence;
+    smbusAlert.setPending(unread || buttonEvents.oldestSequence() != buttonEvents.nextSequence());
+}
+#endif
+
+void loop()
+{
+    scheduler.run();
+    watchdog.refresh(); // Тик обработан: основной цикл не завис
 }
 
 #else
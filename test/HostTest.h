@@ -0,0 +1,49 @@
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <Arduino.h>
+#include <chrono>
+
+/**
+ * @file HostTest.h
+ * @brief Проверки и измерение времени для тестов на хосте (см. test/run_tests.py).
+ */
+
+inline int hostFailures = 0; ///< Количество невыполненных проверок.
+
+/**
+ * @brief Проверяет условие; при невыполнении печатает его и продолжает тест.
+ */
+#define CHECK(...)                                                                          \
+    do                                                                                      \
+    {                                                                                       \
+        if (!(__VA_ARGS__))                                                                 \
+            ++hostFailures, printf("%s:%d: не выполнено: %s\n", __FILE__, __LINE__, #__VA_ARGS__); \
+    } while (0)
+
+/**
+ * @brief Завершает тест: печатает итог и возвращает код завершения программы.
+ * @return 0, если все проверки выполнены.
+ */
+inline int hostTestResult()
+{
+    printf(hostFailures ? "ОШИБКА: %d проверок не выполнено\n" : "OK\n", hostFailures);
+    return hostFailures ? 1 : 0;
+}
+
+/**
+ * @brief Измеряет среднее время вызова функции на хосте.
+ * @param iterations Количество вызовов.
+ * @param body Функция (получает номер вызова).
+ * @return Время одного вызова, нс.
+ */
+template <typename Body>
+double hostNanosecondsPerCall(uint32_t iterations, Body &&body)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; ++i)
+        body(i);
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / iterations;
+}
+
+#endif // HOST_TEST_H
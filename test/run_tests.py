@@ -0,0 +1,47 @@
+#!/usr/bin/env python3
+"""Сборка и запуск тестов заголовков прошивки на хосте (Linux, g++).
+
+Каждый файл test/test_*.cpp – отдельная программа: заголовки из src/ собираются с заглушкой ядра Arduino
+(test/stub/Arduino.h), программа моделирует периферию, печатает результаты измерений и возвращает ненулевой код
+при ошибке. Дополнительные флаги компилятора задаются в файле строкой "// flags: ...". Аргументы после "--"
+передаются каждой запущенной программе (например, файлы записанных сигналов).
+
+    test/run_tests.py [фрагмент имени...] [-- аргументы...]
+"""
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+TEST_DIR = os.path.join(ROOT, "test")
+CXX = os.environ.get("CXX", "g++")
+FLAGS = ["-std=gnu++17", "-O2", "-Wall", "-Wno-parentheses", "-I" + os.path.join(TEST_DIR, "stub"), "-I" + os.path.join(ROOT, "src")]
+
+
+def extra_flags(path):
+    with open(path, encoding="utf-8") as source:
+        match = re.search(r"^// flags: (.*)$", source.read(), re.MULTILINE)
+    return match.group(1).split() if match else []
+
+
+def main():
+    args = sys.argv[1:]
+    parts, test_args = (args[:args.index("--")], args[args.index("--") + 1:]) if "--" in args else (args, [])
+    names = sorted(name for name in os.listdir(TEST_DIR) if name.startswith("test_") and name.endswith(".cpp"))
+    names = [name for name in names if not parts or any(part in name for part in parts)]
+    failed = []
+    with tempfile.TemporaryDirectory() as build:
+        for name in names:
+            source, binary = os.path.join(TEST_DIR, name), os.path.join(build, name[:-4])
+            print(f"=== {name}", flush=True)
+            flags = FLAGS + extra_flags(source)
+            if subprocess.call([CXX, *flags, source, "-o", binary]) or subprocess.call([binary, *test_args]):
+                failed.append(name)
+    print(f"{len(names) - len(failed)}/{len(names)} тестов пройдено" + (": ошибки в " + ", ".join(failed) if failed else ""))
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,228 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+/**
+ * @file Arduino.h
+ * @brief Заглушка ядра Arduino (stm32duino) и CMSIS STM32F103 для тестов заголовков прошивки на хосте (Linux, g++).
+ *
+ * Регистры периферии – обычная память по адресам STM32F103: при запуске теста отображаются области SRAM (0x20000000),
+ * периферии (0x40000000) и системных регистров ядра (0xE0000000). Поэтому код прошивки обращается к регистрам
+ * без изменений, а тест моделирует периферию, читая и записывая те же регистры. Объекты, адреса которых прошивка
+ * записывает в 32-битные регистры (например, буферы DMA), тест размещает в SRAM функцией hostSram().
+ * Время micros() задаёт тест (hostMicros), прерывание таймера HardwareTimer вызывает hostTimerInterrupt().
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <algorithm>
+#include <functional>
+#include <new>
+#include <utility>
+
+using std::max;
+using std::min;
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define OUTPUT_OPEN_DRAIN 3
+
+/**
+ * @brief Номера пинов bluepill в нумерации stm32duino.
+ */
+enum HostPin : uint8_t
+{
+    PA0, PA1, PA2, PA3, PA4, PA5, PA6, PA7, PA8, PA9, PA10, PA11, PA12, PA13, PA14, PA15,
+    PB0, PB1, PB2, PB3, PB4, PB5, PB6, PB7, PB8, PB9, PB10, PB11, PB12, PB13, PB14, PB15,
+    PC13 = 45, PC14, PC15,
+};
+
+#define __IO volatile
+typedef struct { __IO uint32_t CRL, CRH, IDR, ODR, BSRR, BRR, LCKR; } GPIO_TypeDef;
+typedef struct { __IO uint32_t CR1, CR2, SMCR, DIER, SR, EGR, CCMR1, CCMR2, CCER, CNT, PSC, ARR, RCR, CCR1, CCR2, CCR3, CCR4, BDTR, DCR, DMAR; } TIM_TypeDef;
+typedef struct { __IO uint32_t CR, CFGR, CIR, APB2RSTR, APB1RSTR, AHBENR, APB2ENR, APB1ENR, BDCR, CSR; } RCC_TypeDef;
+typedef struct { __IO uint32_t CR1, CR2, SR, DR, CRCPR, RXCRCR, TXCRCR, I2SCFGR, I2SPR; } SPI_TypeDef;
+typedef struct { __IO uint32_t CCR, CNDTR, CPAR, CMAR; } DMA_Channel_TypeDef;
+typedef struct { __IO uint32_t ISR, IFCR; } DMA_TypeDef;
+typedef struct { __IO uint32_t CTRL, CYCCNT; } DWT_Type;
+typedef struct { __IO uint32_t DHCSR, DCRSR, DCRDR, DEMCR; } CoreDebug_Type;
+
+#define SRAM_BASE 0x20000000UL   ///< Начало SRAM (20 КБ на STM32F103C8).
+#define PERIPH_BASE 0x40000000UL ///< Начало области периферии.
+#define TIM2_BASE (PERIPH_BASE + 0x0000)
+#define TIM3_BASE (PERIPH_BASE + 0x0400)
+#define TIM4_BASE (PERIPH_BASE + 0x0800)
+#define SPI2_BASE (PERIPH_BASE + 0x3800)
+#define GPIOA_BASE (PERIPH_BASE + 0x10800)
+#define GPIOB_BASE (PERIPH_BASE + 0x10C00)
+#define GPIOC_BASE (PERIPH_BASE + 0x11000)
+#define TIM1_BASE (PERIPH_BASE + 0x12C00)
+#define SPI1_BASE (PERIPH_BASE + 0x13000)
+#define DMA1_BASE (PERIPH_BASE + 0x20000)
+#define DMA1_Channel1_BASE (DMA1_BASE + 0x08) ///< Каналы DMA1 следуют через 0x14.
+#define RCC_BASE (PERIPH_BASE + 0x21000)
+#define DWT_BASE 0xE0001000UL
+#define CoreDebug_BASE 0xE000EDF0UL
+
+#define TIM1 ((TIM_TypeDef *)TIM1_BASE)
+#define TIM2 ((TIM_TypeDef *)TIM2_BASE)
+#define TIM3 ((TIM_TypeDef *)TIM3_BASE)
+#define TIM4 ((TIM_TypeDef *)TIM4_BASE)
+#define GPIOA ((GPIO_TypeDef *)GPIOA_BASE)
+#define GPIOB ((GPIO_TypeDef *)GPIOB_BASE)
+#define GPIOC ((GPIO_TypeDef *)GPIOC_BASE)
+#define RCC ((RCC_TypeDef *)RCC_BASE)
+#define SPI1 ((SPI_TypeDef *)SPI1_BASE)
+#define SPI2 ((SPI_TypeDef *)SPI2_BASE)
+#define DMA1 ((DMA_TypeDef *)DMA1_BASE)
+#define DMA1_Channel1 ((DMA_Channel_TypeDef *)(DMA1_Channel1_BASE + 0x14 * 0))
+#define DMA1_Channel2 ((DMA_Channel_TypeDef *)(DMA1_Channel1_BASE + 0x14 * 1))
+#define DMA1_Channel3 ((DMA_Channel_TypeDef *)(DMA1_Channel1_BASE + 0x14 * 2))
+#define DMA1_Channel4 ((DMA_Channel_TypeDef *)(DMA1_Channel1_BASE + 0x14 * 3))
+#define DMA1_Channel5 ((DMA_Channel_TypeDef *)(DMA1_Channel1_BASE + 0x14 * 4))
+#define DMA1_Channel6 ((DMA_Channel_TypeDef *)(DMA1_Channel1_BASE + 0x14 * 5))
+#define DMA1_Channel7 ((DMA_Channel_TypeDef *)(DMA1_Channel1_BASE + 0x14 * 6))
+#define DWT ((DWT_Type *)DWT_BASE)
+#define CoreDebug ((CoreDebug_Type *)CoreDebug_BASE)
+
+#define DWT_CTRL_CYCCNTENA_Msk 1UL
+#define CoreDebug_DEMCR_TRCENA_Msk (1UL << 24)
+#define RCC_APB2ENR_TIM1EN (1UL << 11)
+#define RCC_APB1ENR_TIM2EN (1UL << 0)
+#define RCC_APB1ENR_TIM3EN (1UL << 1)
+#define RCC_APB1ENR_TIM4EN (1UL << 2)
+#define RCC_APB1ENR_SPI2EN (1UL << 14)
+#define RCC_APB2ENR_SPI1EN (1UL << 12)
+#define RCC_AHBENR_DMA1EN (1UL << 0)
+#define SPI_CR1_CPHA (1UL << 0)
+#define SPI_CR1_CPOL (1UL << 1)
+#define SPI_CR1_MSTR (1UL << 2)
+#define SPI_CR1_BR_Pos 3
+#define SPI_CR1_SPE (1UL << 6)
+#define SPI_CR1_LSBFIRST (1UL << 7)
+#define SPI_CR1_SSI (1UL << 8)
+#define SPI_CR1_SSM (1UL << 9)
+#define SPI_CR2_RXDMAEN (1UL << 0)
+#define SPI_CR2_TXDMAEN (1UL << 1)
+#define DMA_CCR_EN (1UL << 0)
+#define DMA_CCR_TCIE (1UL << 1)
+#define DMA_CCR_DIR (1UL << 4)
+#define DMA_CCR_CIRC (1UL << 5)
+#define DMA_CCR_MINC (1UL << 7)
+#define TIM_CR1_CEN (1UL << 0)
+#define TIM_SMCR_SMS_0 (1UL << 0)
+#define TIM_SMCR_SMS_1 (1UL << 1)
+#define TIM_SMCR_SMS (7UL << 0)
+#define TIM_CCMR1_CC1S_0 (1UL << 0)
+#define TIM_CCMR1_CC2S_0 (1UL << 8)
+#define TIM_CCMR1_IC1F_Pos 4
+#define TIM_CCMR1_IC2F_Pos 12
+
+#define FLASH_PAGE_SIZE 0x400U
+#define FLASH_TYPEERASE_PAGES 0x00U
+#define FLASH_TYPEPROGRAM_HALFWORD 0x01U
+
+typedef enum { HAL_OK, HAL_ERROR, HAL_BUSY, HAL_TIMEOUT } HAL_StatusTypeDef;
+typedef struct { uint32_t TypeErase, Banks, PageAddress, NbPages; } FLASH_EraseInitTypeDef;
+
+// Функции HAL для flash только объявлены: тесты подставляют в FlashStore свою модель flash вместо Stm32Flash
+HAL_StatusTypeDef HAL_FLASH_Unlock();
+HAL_StatusTypeDef HAL_FLASH_Lock();
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t type, uint32_t address, uint64_t data);
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef *init, uint32_t *pageError);
+
+inline uint32_t SystemCoreClock = 72000000; ///< Частота ядра, Гц.
+
+/**
+ * @brief Отображает области памяти STM32F103 по их адресам (до конструкторов глобальных объектов теста).
+ */
+__attribute__((constructor(101))) static void hostMapMemory()
+{
+    static const struct { uintptr_t base; size_t size; } regions[] = {
+        {SRAM_BASE, 0x5000}, {PERIPH_BASE, 0x24000}, {0xE0000000UL, 0x10000}};
+    for (const auto &region : regions)
+        if (mmap((void *)region.base, region.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0) != (void *)region.base)
+        {
+            fprintf(stderr, "Не удалось отобразить память по адресу 0x%08lx\n", (unsigned long)region.base);
+            exit(2);
+        }
+}
+
+/**
+ * @brief Создаёт объект в SRAM (адрес помещается в 32-битный регистр, как на микроконтроллере).
+ * @return Указатель на объект; память не освобождается до конца теста.
+ */
+template <typename T, typename... Args>
+T *hostSram(Args &&...args)
+{
+    static uintptr_t next = SRAM_BASE;
+    next = (next + alignof(T) - 1) & ~(uintptr_t)(alignof(T) - 1);
+    T *object = new ((void *)next) T(std::forward<Args>(args)...);
+    next += sizeof(T);
+    return object;
+}
+
+inline uint64_t hostMicros = 0; ///< Время теста в микросекундах (возвращается micros() по модулю 2^32).
+inline uint32_t micros() { return (uint32_t)hostMicros; }
+inline uint32_t millis() { return (uint32_t)(hostMicros / 1000); }
+
+inline GPIO_TypeDef *digitalPinToPort(uint32_t pin) { return pin < PB0 ? GPIOA : pin < PC13 ? GPIOB : GPIOC; }
+inline uint32_t digitalPinToBitMask(uint32_t pin) { return 1UL << (pin % 16); }
+inline void pinMode(uint32_t, uint32_t) {}
+inline int digitalRead(uint32_t pin) { return (digitalPinToPort(pin)->IDR & digitalPinToBitMask(pin)) ? HIGH : LOW; }
+inline void digitalWrite(uint32_t pin, uint32_t value)
+{
+    GPIO_TypeDef *port = digitalPinToPort(pin);
+    port->ODR = value ? port->ODR | digitalPinToBitMask(pin) : port->ODR & ~digitalPinToBitMask(pin);
+}
+
+inline void __disable_irq() {}
+inline void __enable_irq() {}
+inline void __DMB() { __atomic_signal_fence(__ATOMIC_SEQ_CST); }
+inline void __WFI() {}
+
+typedef enum { TICK_FORMAT, MICROSEC_FORMAT, HERTZ_FORMAT } TimerFormat_t;
+typedef std::function<void(void)> callback_function_t;
+
+/**
+ * @brief Таймер stm32duino: хранит обработчик прерывания, который вызывает тест (hostTimerInterrupt()).
+ */
+class HardwareTimer
+{
+public:
+    explicit HardwareTimer(TIM_TypeDef *instance) : instance(instance) { timers[index(instance)] = this; }
+    void setOverflow(uint32_t value, TimerFormat_t format = TICK_FORMAT) { overflow = value, overflowFormat = format; }
+    void attachInterrupt(callback_function_t callback) { this->callback = callback; }
+    void resume() { running = true; }
+    void pause() { running = false; }
+
+    static uint8_t index(TIM_TypeDef *instance) { return instance == TIM1 ? 0 : instance == TIM2 ? 1 : instance == TIM3 ? 2 : 3; } ///< @brief Номер таймера TIM1..TIM4.
+
+    static inline HardwareTimer *timers[4] = {}; ///< Созданные таймеры TIM1..TIM4.
+    TIM_TypeDef *const instance;                 ///< Таймер.
+    uint32_t overflow = 0;                       ///< Значение setOverflow().
+    TimerFormat_t overflowFormat = TICK_FORMAT;  ///< Формат значения setOverflow().
+    callback_function_t callback;                ///< Обработчик прерывания переполнения.
+    bool running = false;                        ///< Таймер запущен.
+};
+
+/**
+ * @brief Вызывает обработчик прерывания переполнения таймера, если таймер создан и запущен.
+ * @return HardwareTimer таймера или nullptr.
+ */
+inline HardwareTimer *hostTimerInterrupt(TIM_TypeDef *instance)
+{
+    HardwareTimer *timer = HardwareTimer::timers[HardwareTimer::index(instance)];
+    if (timer && timer->running && timer->callback)
+        timer->callback();
+    return timer;
+}
+
+#endif // HOST_ARDUINO_H
@@ -0,0 +1,176 @@
+/**
+ * @file test_adaptive_debounce.cpp
+ * @brief Моделирование AdaptiveDebounce в обработчике кнопки: обучение на разных профилях дребезга, задержка
+ * реакции по сравнению с фиксированной задержкой 50 мс, отсутствие ложных срабатываний и пропусков, короткие касания
+ * и помехи при удержании.
+ *
+ * Сигнал кнопки опрашивается с частотой прошивки (1 кГц); фронты дребезга попадают на отсчёты.
+ */
+
+#include <vector>
+#include <utility>
+#include "HostTest.h"
+#include "ButtonHandler.h"
+
+static const uint32_t DEBOUNCE_US = 50000, LONG_PRESS_US = 500000;
+typedef BasicButtonHandler<ButtonConfig, AdaptiveDebounce<3000, 2000>> AdaptiveButton;
+
+/**
+ * @brief Сигнал кнопки с нажатиями: фронты с точностью до миллисекунды.
+ */
+struct Signal
+{
+    std::vector<std::pair<uint32_t, bool>> edges; ///< Время (мс) и уровень после фронта (true – отпущена).
+    std::vector<uint32_t> presses;                ///< Моменты первых фронтов нажатий, мс.
+    uint32_t now = 100;                           ///< Конец сигнала, мс.
+
+    /**
+     * @brief Переключение с дребезгом: возвраты уровня в пределах bounceMs после первого фронта.
+     */
+    void burst(bool level, uint32_t bounceMs)
+    {
+        edges.push_back({now, level});
+        for (uint32_t t = 1; t + 1 <= bounceMs; t += 2)
+            edges.push_back({now + t, !level}), edges.push_back({now + t + 1, level});
+    }
+
+    /**
+     * @brief Нажатие длительностью holdMs с паузой gapMs перед ним.
+     */
+    void press(uint32_t gapMs, uint32_t holdMs, uint32_t bounceMs)
+    {
+        now += gapMs;
+        presses.push_back(now);
+        burst(false, bounceMs);
+        now += holdMs;
+        burst(true, bounceMs);
+    }
+
+    void glitch(uint32_t atMs, uint32_t widthMs, bool level) ///< @brief Помеха: уровень level на widthMs.
+    {
+        edges.push_back({atMs, level}), edges.push_back({atMs + widthMs, !level});
+    }
+};
+
+/**
+ * @brief Результат прогона сигнала через обработчик.
+ */
+struct Outcome
+{
+    uint32_t presses;   ///< Распознанные нажатия (кратковременные и длительные).
+    uint32_t starts;    ///< Переходы isPressedNow() в true.
+    double avgLatency;  ///< Средняя задержка признания нажатия после обучения (начиная с 9-го нажатия), мс.
+};
+
+template <class Button>
+static Outcome run(Button &button, Signal signal, uint32_t fromPress = 8)
+{
+    std::sort(signal.edges.begin(), signal.edges.end(), [](auto &a, auto &b) { return a.first < b.first; });
+    Outcome outcome = {};
+    bool level = true, wasPressed = false;
+    size_t e = 0, p = 0;
+    double latencySum = 0;
+    uint32_t measured = 0;
+    for (uint32_t ms = 0; ms < signal.now + 1000; ++ms)
+    {
+        for (; e < signal.edges.size() && signal.edges[e].first <= ms; ++e)
+            level = signal.edges[e].second;
+        button.updateState(level, (uint64_t)ms * 1000);
+        outcome.presses += button.isShortPress() + button.isLongPress();
+        if (button.isPressedNow() && !wasPressed)
+        {
+            ++outcome.starts;
+            for (; p + 1 < signal.presses.size() && signal.presses[p + 1] <= ms; ++p)
+                ;
+            if (p >= fromPress)
+                latencySum += ms - signal.presses[p], ++measured;
+        }
+        wasPressed = button.isPressedNow();
+    }
+    outcome.avgLatency = measured ? latencySum / measured : 0;
+    return outcome;
+}
+
+int main()
+{
+    srand(1);
+    { // Чистый дребезг 2 мс, затем одиночное касание 30 мс: задержка остаётся ~5 мс, касание – нажатие
+        AdaptiveButton button(ButtonConfig::NO_PIN, DEBOUNCE_US, LONG_PRESS_US);
+        Signal signal;
+        for (int i = 0; i < 12; ++i)
+            signal.press(200, 100, 2);
+        Outcome learned = run(button, signal);
+        uint32_t before = button.debouncer().effectiveDelay(DEBOUNCE_US);
+        Signal tap;
+        tap.now = signal.now + 1200;
+        tap.press(0, 30, 2);
+        for (int i = 0; i < 8; ++i)
+            tap.press(200, 100, 2);
+        AdaptiveButton replay = button;
+        Outcome after = run(replay, tap, 0);
+        uint32_t afterDelay = replay.debouncer().effectiveDelay(DEBOUNCE_US);
+        printf("Дребезг 2 мс: задержка %u мкс; после касания 30 мс – %u мкс, нажатий %u из %zu\n",
+               before, afterDelay, after.presses, tap.presses.size());
+        CHECK(learned.presses == 12 && before == 5000);
+        CHECK(afterDelay == 5000 && after.presses == tap.presses.size());
+    }
+
+    struct Profile
+    {
+        const char *name;
+        uint32_t bounceMinMs, bounceMaxMs;
+    };
+    static const Profile profiles[] = {
+        {"микропереключатель (0..1 мс)", 0, 1},
+        {"тактовая кнопка (1..4 мс)", 1, 4},
+        {"изношенная кнопка (6..16 мс)", 6, 16},
+    };
+    for (const Profile &profile : profiles)
+    {
+        Signal signal;
+        for (int i = 0; i < 300; ++i)
+            signal.press(100 + rand() % 900, 60 + rand() % 900,
+                         profile.bounceMinMs + rand() % (profile.bounceMaxMs - profile.bounceMinMs + 1));
+        AdaptiveButton adaptive(ButtonConfig::NO_PIN, DEBOUNCE_US, LONG_PRESS_US);
+        ButtonHandler fixed(ButtonConfig::NO_PIN, DEBOUNCE_US, LONG_PRESS_US);
+        Outcome a = run(adaptive, signal), f = run(fixed, signal);
+        printf("%s: задержка нажатия %.1f мс (фиксированная 50 мс: %.1f мс), рабочая задержка %u мкс, "
+               "нажатий %u/%u из %zu\n", profile.name, a.avgLatency, f.avgLatency,
+               adaptive.debouncer().effectiveDelay(DEBOUNCE_US), a.presses, a.starts, signal.presses.size());
+        CHECK(a.presses == signal.presses.size() && a.starts == signal.presses.size()); // Нет пропусков и ложных нажатий
+        CHECK(a.avgLatency < f.avgLatency);
+    }
+
+    { // Смена профиля: тактовая кнопка, затем долгий дребезг – задержка растёт без ложных нажатий
+        Signal signal;
+        for (int i = 0; i < 100; ++i)
+            signal.press(300, 200, 2);
+        for (int i = 0; i < 100; ++i)
+            signal.press(300, 200, 12);
+        AdaptiveButton button(ButtonConfig::NO_PIN, DEBOUNCE_US, LONG_PRESS_US);
+        Outcome outcome = run(button, signal);
+        printf("Смена профиля 2 -> 12 мс: рабочая задержка %u мкс, нажатий %u/%u из %zu\n",
+               button.debouncer().effectiveDelay(DEBOUNCE_US), outcome.presses, outcome.starts, signal.presses.size());
+        CHECK(outcome.presses == signal.presses.size() && outcome.starts == signal.presses.size());
+        CHECK(button.debouncer().effectiveDelay(DEBOUNCE_US) >= 12000 * 3 / 2);
+    }
+
+    { // Помехи 1..3 мс при удержании и в покое не учитываются как дребезг и не дают нажатий
+        Signal signal;
+        for (int i = 0; i < 100; ++i)
+        {
+            signal.press(300, 300, 2);
+            signal.glitch(signal.now - 150, 1 + rand() % 3, true); // При удержании
+            signal.glitch(signal.now + 150, 1 + rand() % 3, false); // В покое
+        }
+        signal.now += 300;
+        AdaptiveButton button(ButtonConfig::NO_PIN, DEBOUNCE_US, LONG_PRESS_US);
+        Outcome outcome = run(button, signal);
+        printf("Помехи 1..3 мс: рабочая задержка %u мкс, нажатий %u/%u из %zu\n",
+               button.debouncer().effectiveDelay(DEBOUNCE_US), outcome.presses, outcome.starts, signal.presses.size());
+        CHECK(outcome.presses == signal.presses.size() && outcome.starts == signal.presses.size());
+        CHECK(button.debouncer().effectiveDelay(DEBOUNCE_US) == 5000);
+    }
+    printf("Состояние AdaptiveDebounce: %zu байт\n", sizeof(AdaptiveDebounce<3000, 2000>));
+    return hostTestResult();
+}
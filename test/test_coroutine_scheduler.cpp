@@ -0,0 +1,109 @@
+// flags: -std=gnu++20 -fcoroutines -Wno-volatile
+/**
+ * @file test_coroutine_scheduler.cpp
+ * @brief Проверка CoScheduler (пул кадров, порядок продолжения задач) и сравнение накладных расходов на хосте:
+ * прямой вызов задач в цикле, таблица задач TickScheduler и три сопрограммы, как в сборке COROUTINE_TASKS
+ * (выполнение команд I2C, опрос кнопок, светодиоды).
+ *
+ * Тела задач пустые (счётчики), поэтому измеряется только цена диспетчеризации. Время – на процессоре хоста;
+ * на устройстве накладные расходы прохода сопрограмм в тактах возвращает команда 0x47, тиков – команда 0x46.
+ */
+
+#include "HostTest.h"
+#include "TickScheduler.h"
+#include "CoroutineScheduler.h"
+
+static volatile uint32_t busRuns, buttonRuns, ledRuns; // Работа задач
+static CoEvent ledUpdate;
+
+static void serviceBus() { ++busRuns; }
+static void scanButtons() { ++buttonRuns; }
+
+static CoTask busTask()
+{
+    for (;;)
+    {
+        serviceBus();
+        if (busRuns % 16 == 0) // Изредка – команда записи светодиодов
+            ledUpdate.signal();
+        co_await CoSleep(1);
+    }
+}
+
+static CoTask buttonTask()
+{
+    for (;;)
+    {
+        scanButtons();
+        co_await CoSleep(1);
+    }
+}
+
+static CoTask ledTask()
+{
+    for (;;)
+    {
+        co_await ledUpdate;
+        ++ledRuns;
+    }
+}
+
+static CoTask oneShot()
+{
+    co_await CoSleep(1);
+}
+
+static CoTask largeFrame()
+{
+    volatile uint8_t buffer[COROUTINE_FRAME_SIZE];
+    buffer[0] = 1;
+    co_await CoSleep(1);
+    buffer[1] = buffer[0];
+}
+
+static CoScheduler coroutines;
+static void runCoroutines() { coroutines.run(); }
+
+static void serviceBusWithLed()
+{
+    serviceBus();
+    if (busRuns % 16 == 0)
+        ++ledRuns;
+}
+
+static const SchedulerTask loopTasks[] = {{serviceBusWithLed, 1, 0}, {scanButtons, 1, 0}};
+static const SchedulerTask coroutineTasks[] = {{runCoroutines, 1, 0}};
+
+int main()
+{
+    coroutines.begin();
+    { // Пул кадров: COROUTINE_MAX_TASKS задач, слишком большой кадр и лишняя задача не запускаются
+        CHECK(!coroutines.spawn(largeFrame()));
+        CHECK(coroutines.spawn(oneShot()));
+        coroutines.run(), coroutines.run(); // Завершённая задача освобождает ячейку
+        CHECK(coroutines.spawn(busTask()) && coroutines.spawn(buttonTask()) && coroutines.spawn(ledTask()));
+        CHECK(!coroutines.spawn(oneShot()));
+    }
+    { // Событие, установленное задачей команд, продолжает задачу светодиодов в том же проходе
+        busRuns = buttonRuns = ledRuns = 0;
+        for (int i = 0; i < 64; ++i)
+            coroutines.run();
+        CHECK(busRuns == 64 && buttonRuns == 64 && ledRuns == 4);
+    }
+
+    const uint32_t passes = 2000000;
+    double loopNs = hostNanosecondsPerCall(passes, [](uint32_t) { serviceBusWithLed(), scanButtons(); });
+    TickScheduler<2> tickLoop(loopTasks, 1000);
+    tickLoop.begin(TIM2);
+    double tickNs = hostNanosecondsPerCall(passes, [&](uint32_t) { hostTimerInterrupt(TIM2), tickLoop.run(); });
+    TickScheduler<1> tickCoroutines(coroutineTasks, 1000);
+    tickCoroutines.begin(TIM3);
+    busRuns = ledRuns = 0;
+    double coroutineNs = hostNanosecondsPerCall(passes, [&](uint32_t) { hostTimerInterrupt(TIM3), tickCoroutines.run(); });
+    CHECK(ledRuns == busRuns / 16);
+    printf("Проход (хост): цикл %.1f нс, TickScheduler %.1f нс (+%.1f), TickScheduler + 3 сопрограммы %.1f нс (+%.1f)\n",
+           loopNs, tickNs, tickNs - loopNs, coroutineNs, coroutineNs - loopNs);
+    printf("При тике 1 кГц: накладные расходы сопрограмм относительно цикла – %.4f %% времени процессора хоста\n",
+           (coroutineNs - loopNs) * 1000 / 1e9 * 100);
+    return hostTestResult();
+}
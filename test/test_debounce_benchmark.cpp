@@ -0,0 +1,321 @@
+/**
+ * @file test_debounce_benchmark.cpp
+ * @brief Сравнение стратегий устранения дребезга (Debounce.h) на библиотеке сигналов кнопок: время обработки
+ * отсчёта на хосте, размер состояния, задержка реакции и доля ложных и пропущенных переключений.
+ *
+ * Синтетические сигналы: тактовая кнопка, микропереключатель, изношенная кнопка с долгим дребезгом, помехи
+ * при удержании и короткие касания. Записанные сигналы передаются файлами в аргументах
+ * (test/run_tests.py debounce -- запись.txt ...): строка файла – фронт "время_мкс уровень" (1 – отпущена).
+ * Настоящие переключения записи – пачки фронтов, разделённые паузой не меньше CAPTURE_GAP_US, после которых
+ * уровень отличается от прежнего; пачка, вернувшаяся к прежнему уровню, считается помехой.
+ *
+ * Сигнал опрашивается с частотой прошивки (1 кГц). Задержка – от первого фронта настоящего переключения
+ * до изменения уровня на выходе стратегии; ложное срабатывание – лишнее изменение уровня на выходе;
+ * пропуск – настоящее переключение, после которого выход не изменился до следующего.
+ */
+
+#include <math.h>
+#include <vector>
+#include <string>
+#include <utility>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "HostTest.h"
+#include "Debounce.h"
+
+static const uint32_t SAMPLE_US = 1000;        ///< Период опроса кнопок в прошивке.
+static const uint32_t DEBOUNCE_US = 50000;     ///< Задержка стратегий по метке времени (debounceDelay прошивки).
+static const uint32_t CAPTURE_GAP_US = 10000;  ///< Пауза, разделяющая пачки фронтов записанного сигнала.
+
+/**
+ * @brief Сигнал кнопки: фронты и настоящие переключения.
+ */
+struct Waveform
+{
+    std::string name;
+    std::vector<std::pair<double, bool>> edges; ///< Фронты: время (мкс) и уровень после фронта.
+    std::vector<std::pair<double, bool>> truth; ///< Настоящие переключения: время первого фронта и новый уровень.
+    double end = 0;                             ///< Длительность сигнала, мкс.
+
+    std::vector<bool> samples() const ///< @brief Отсчёты с периодом SAMPLE_US.
+    {
+        std::vector<bool> out;
+        bool level = true;
+        size_t i = 0;
+        for (double t = 0; t < end; t += SAMPLE_US)
+        {
+            for (; i < edges.size() && edges[i].first <= t; ++i)
+                level = edges[i].second;
+            out.push_back(level);
+        }
+        return out;
+    }
+};
+
+/**
+ * @brief Профиль синтетического сигнала.
+ */
+struct Profile
+{
+    const char *name;
+    double bounceMinUs, bounceMaxUs; ///< Длительность пачки дребезга.
+    uint8_t maxGlitches;             ///< Наибольшее число возвратов уровня в пачке.
+    double holdMinMs, holdMaxMs;     ///< Длительность нажатия.
+    double gapMinMs, gapMaxMs;       ///< Пауза между нажатиями.
+    double spikesPerSecond;          ///< Частота помех (кратковременных изменений уровня) вне пачек.
+    double spikeMaxUs;               ///< Наибольшая длительность помехи.
+};
+
+static double uniform(double low, double high) { return low + (high - low) * rand() / RAND_MAX; }
+
+/**
+ * @brief Переключение с пачкой дребезга: первый фронт в момент t, последний – не позже t + bounce.
+ * @return Момент последнего фронта.
+ */
+static double addBurst(Waveform &wave, double t, bool level, const Profile &profile)
+{
+    double bounce = uniform(profile.bounceMinUs, profile.bounceMaxUs);
+    uint8_t glitches = profile.maxGlitches ? 1 + rand() % profile.maxGlitches : 0;
+    std::vector<double> times;
+    for (uint8_t i = 0; i < glitches * 2; ++i)
+        times.push_back(t + uniform(0, bounce));
+    std::sort(times.begin(), times.end());
+    wave.truth.push_back({t, level});
+    wave.edges.push_back({t, level});
+    for (uint8_t i = 0; i < times.size(); ++i)
+        wave.edges.push_back({times[i], i % 2 ? level : !level});
+    return times.empty() ? t : times.back();
+}
+
+/**
+ * @brief Помехи на интервале установившегося уровня (не ближе 2 мс к пачкам).
+ */
+static void addSpikes(Waveform &wave, double from, double to, bool level, const Profile &profile)
+{
+    for (double t = from + 2000; t < to - 2000 - profile.spikeMaxUs; t += 1000)
+        if (uniform(0, 1) < profile.spikesPerSecond / 1000)
+        {
+            double width = uniform(50, profile.spikeMaxUs);
+            wave.edges.push_back({t, !level});
+            wave.edges.push_back({t + width, level});
+            t += width;
+        }
+}
+
+static Waveform synthesize(const Profile &profile, uint32_t presses)
+{
+    Waveform wave;
+    wave.name = profile.name;
+    double t = 100000, settled = 0;
+    for (uint32_t i = 0; i < presses; ++i)
+    {
+        double press = t + uniform(profile.gapMinMs, profile.gapMaxMs) * 1000;
+        addSpikes(wave, settled, press, true, profile);
+        settled = addBurst(wave, press, false, profile);
+        double release = press + uniform(profile.holdMinMs, profile.holdMaxMs) * 1000;
+        addSpikes(wave, settled, release, false, profile);
+        settled = addBurst(wave, release, true, profile);
+        t = release;
+    }
+    wave.end = t + 200000;
+    addSpikes(wave, settled, wave.end, true, profile);
+    std::sort(wave.edges.begin(), wave.edges.end(), [](auto &a, auto &b) { return a.first < b.first; });
+    return wave;
+}
+
+/**
+ * @brief Загружает записанный сигнал и выделяет настоящие переключения (см. описание файла).
+ */
+static bool loadCapture(const char *path, Waveform &wave)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return false;
+    wave.name = path;
+    double time, burstStart = 0, lastEdge = -1e12;
+    int level;
+    bool settled = true, current = true;
+    while (fscanf(file, "%lf %d", &time, &level) == 2)
+    {
+        if (time - lastEdge >= CAPTURE_GAP_US)
+        {
+            if (current != settled) // Предыдущая пачка изменила уровень
+                wave.truth.push_back({burstStart, current}), settled = current;
+            burstStart = time;
+        }
+        wave.edges.push_back({time, level != 0});
+        current = level != 0, lastEdge = time;
+    }
+    fclose(file);
+    if (current != settled)
+        wave.truth.push_back({burstStart, current});
+    wave.end = lastEdge + 200000;
+    return !wave.edges.empty();
+}
+
+/**
+ * @brief Результаты стратегии на сигнале.
+ */
+struct Metrics
+{
+    double nsPerSample;     ///< Время обработки отсчёта на хосте, нс.
+    double tscPerSample;    ///< То же в тактах TSC хоста (0, если счётчика нет).
+    size_t stateBytes;      ///< Размер состояния.
+    double avgLatencyMs;    ///< Средняя задержка реакции.
+    double maxLatencyMs;    ///< Худшая задержка реакции.
+    uint32_t falseTriggers; ///< Лишние изменения выхода.
+    uint32_t missed;        ///< Пропущенные переключения.
+};
+
+/**
+ * @brief Печатает строку UTF-8, дополненную пробелами до ширины в символах.
+ */
+static void printPadded(const char *text, int width)
+{
+    for (const char *c = text; *c; ++c)
+        width -= (*c & 0xC0) != 0x80;
+    printf("%s%*s", text, max(width, 0), "");
+}
+
+static uint64_t readTsc()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+template <class Debounce>
+static Metrics evaluate(const Waveform &wave, const std::vector<bool> &samples)
+{
+    Metrics metrics = {};
+    metrics.stateBytes = sizeof(Debounce);
+
+    std::vector<std::pair<double, bool>> changes; // Изменения выхода
+    {
+        Debounce debounce;
+        bool output = true;
+        for (size_t i = 0; i < samples.size(); ++i)
+        {
+            bool level = debounce.update(samples[i], (uint64_t)i * SAMPLE_US, DEBOUNCE_US);
+            if (level != output)
+                changes.push_back({(double)i * SAMPLE_US, level}), output = level;
+        }
+    }
+    { // Время обработки отсчёта – отдельным проходом без записи результатов
+        Debounce debounce;
+        volatile bool sink = false;
+        uint64_t tsc = readTsc();
+        metrics.nsPerSample = hostNanosecondsPerCall(samples.size(), [&](uint32_t i) { sink = debounce.update(samples[i], (uint64_t)i * SAMPLE_US, DEBOUNCE_US); });
+        metrics.tscPerSample = (double)(readTsc() - tsc) / samples.size();
+    }
+
+    size_t c = 0;
+    bool output = true;
+    for (; c < changes.size() && (wave.truth.empty() || changes[c].first < wave.truth[0].first); ++c)
+        ++metrics.falseTriggers, output = changes[c].second;
+    double latencySum = 0;
+    uint32_t detected = 0;
+    for (size_t t = 0; t < wave.truth.size(); ++t)
+    {
+        double windowEnd = t + 1 < wave.truth.size() ? wave.truth[t + 1].first : 1e18;
+        bool expected = wave.truth[t].second, reacted = output == expected;
+        for (; c < changes.size() && changes[c].first < windowEnd; ++c)
+        {
+            if (!reacted && changes[c].second == expected)
+            {
+                double latency = (changes[c].first - wave.truth[t].first) / 1000;
+                latencySum += latency, ++detected, reacted = true;
+                metrics.maxLatencyMs = max(metrics.maxLatencyMs, latency);
+            }
+            else
+                ++metrics.falseTriggers;
+            output = changes[c].second;
+        }
+        metrics.missed += !reacted;
+    }
+    metrics.avgLatencyMs = detected ? latencySum / detected : 0;
+    return metrics;
+}
+
+/**
+ * @brief Стратегия в таблице сравнения.
+ */
+struct Policy
+{
+    const char *name;
+    Metrics (*evaluate)(const Waveform &, const std::vector<bool> &);
+};
+
+static const Policy POLICIES[] = {
+    {"Timestamp 50 мс", evaluate<TimestampDebounce>},
+    {"Adaptive 3..50 мс", evaluate<AdaptiveDebounce<3000, 2000>>},
+    {"Integrator 8", evaluate<IntegratorDebounce<8>>},
+    {"ShiftRegister 8", evaluate<ShiftRegisterDebounce<8>>},
+    {"VerticalCounter 4", evaluate<VerticalCounterDebounce>},
+    {"PassThrough", evaluate<PassThroughDebounce>},
+};
+
+/**
+ * @brief Печатает таблицу стратегий на сигнале и рекомендует стратегию без ошибок с наименьшей худшей задержкой.
+ * @return Результаты в порядке POLICIES.
+ */
+static std::vector<Metrics> report(const Waveform &wave)
+{
+    std::vector<bool> samples = wave.samples();
+    std::vector<Metrics> results;
+    printf("\n%s: %zu переключений, %zu фронтов\n", wave.name.c_str(), wave.truth.size(), wave.edges.size());
+    printf("  "), printPadded("стратегия", 18);
+    for (const char *column : {"нс/отсч.", "TSC/отсч.", "байт", "ср., мс", "макс., мс", "ложн./проп."})
+        printf(" "), printPadded(column, 11);
+    printf("\n");
+    const Policy *best = nullptr;
+    double bestLatency = 1e18;
+    for (const Policy &policy : POLICIES)
+    {
+        Metrics m = policy.evaluate(wave, samples);
+        results.push_back(m);
+        printf("  "), printPadded(policy.name, 18);
+        printf(" %-11.2f %-11.1f %-11zu %-11.1f %-11.1f %u/%u\n", m.nsPerSample, m.tscPerSample, m.stateBytes,
+               m.avgLatencyMs, m.maxLatencyMs, m.falseTriggers, m.missed);
+        if (!m.falseTriggers && !m.missed && m.maxLatencyMs < bestLatency)
+            best = &policy, bestLatency = m.maxLatencyMs;
+    }
+    printf("  рекомендуется: %s\n", best ? best->name : "нет стратегии без ошибок");
+    return results;
+}
+
+int main(int argc, char **argv)
+{
+    static const Profile profiles[] = {
+        //  имя                                 дребезг, мкс  возвр. нажатие, мс паузы, мс  помехи/с, мкс
+        {"тактовая кнопка", 500, 3000, 6, 60, 1000, 100, 1000, 0, 0},
+        {"микропереключатель", 100, 500, 3, 60, 1000, 100, 1000, 0, 0},
+        {"изношенная кнопка (дребезг до 20 мс)", 5000, 20000, 12, 80, 1000, 100, 1000, 0, 0},
+        {"помехи при удержании (ЭМП)", 500, 3000, 6, 300, 2000, 300, 2000, 10, 5000},
+        {"короткие касания (20..45 мс)", 500, 2000, 4, 20, 45, 100, 300, 0, 0},
+    };
+    srand(1);
+    std::vector<std::vector<Metrics>> results;
+    for (const Profile &profile : profiles)
+        results.push_back(report(synthesize(profile, 400)));
+    for (int i = 1; i < argc; ++i)
+    {
+        Waveform capture;
+        if (loadCapture(argv[i], capture))
+            report(capture);
+        else
+            printf("\nНе удалось прочитать запись %s\n", argv[i]), ++hostFailures;
+    }
+
+    enum { TIMESTAMP, ADAPTIVE, INTEGRATOR, SHIFT, VERTICAL, PASS };
+    for (size_t p = 0; p + 1 < sizeof profiles / sizeof profiles[0]; ++p) // Кроме коротких касаний
+        CHECK(results[p][TIMESTAMP].falseTriggers == 0 && results[p][TIMESTAMP].missed == 0);
+    CHECK(results[0][ADAPTIVE].maxLatencyMs < results[0][TIMESTAMP].maxLatencyMs); // Адаптивная стратегия быстрее на обычной кнопке
+    CHECK(results[0][PASS].falseTriggers > 0);                                     // Без фильтра дребезг даёт ложные срабатывания
+    CHECK(results[3][VERTICAL].falseTriggers > 0);                                 // Помеха до 5 мс длиннее окна 4 отсчётов
+    CHECK(results[4][TIMESTAMP].missed > 0);                                       // Касание короче 50 мс не проходит фильтр
+    return hostTestResult();
+}
@@ -0,0 +1,165 @@
+/**
+ * @file test_event_log.cpp
+ * @brief Моделирование журнала событий (команды 0x4D, 0x4E) на шине с потерями: потерянные ответы и подтверждения,
+ * конвейерное чтение с номера следующей записи, сброс ведущего, переполнение журнала и переход номеров через 65535.
+ *
+ * Ведущий опрашивает журнал, как в протоколе: чтение с номера (или без номера – с самой старой записи) возвращает
+ * до 3 записей, подтверждение – номер последней обработанной записи. Записи журнала – сквозные номера событий
+ * писателя, поэтому пропуски, повторы и нарушения порядка видны по содержимому.
+ */
+
+#include "HostTest.h"
+#include "EventLog.h"
+
+static const uint8_t EVENTS_PER_READ = 3; // Как в прошивке: заголовок и 3 записи ButtonEvent – до 32 байт
+typedef EventLog<uint32_t, 32> Log;
+
+/**
+ * @brief Параметры шины и ведущего.
+ */
+struct Scenario
+{
+    const char *name;
+    uint8_t lostResponsePercent; ///< Потерянные ответы на чтение.
+    uint8_t lostAckPercent;      ///< Подтверждения, не принятые ведомым (NACK) и повторяемые на следующем опросе.
+    uint8_t ackEvery;            ///< Подтверждение после стольких успешных чтений (конвейерное чтение).
+    uint16_t resetEvery;         ///< Сброс ведущего (потеря номера следующей записи) раз в столько опросов; 0 – нет.
+    uint16_t stallEvery;         ///< Пауза ведущего на 100 опросов раз в столько опросов (переполнение); 0 – нет.
+};
+
+/**
+ * @brief Результат прогона.
+ */
+struct Result
+{
+    uint32_t produced = 0;   ///< Записи, принятые журналом.
+    uint32_t dropped = 0;    ///< Записи, отброшенные журналом.
+    uint32_t delivered = 0;  ///< Записи, обработанные ведущим (без повторов).
+    uint32_t duplicates = 0; ///< Повторно полученные после сброса ведущего записи.
+    uint32_t gaps = 0;       ///< Пропущенные ведущим номера событий (должны совпасть с отброшенными записями).
+    uint32_t errors = 0;     ///< Удаление неполученных записей и нарушения порядка.
+    uint32_t reads = 0, lostReads = 0;
+};
+
+static Result run(const Scenario &scenario, uint32_t polls)
+{
+    Log log;
+    Result result;
+    uint32_t nextEvent = 0;                // Номер события у писателя
+    int64_t lastProcessed = -1;            // Последнее обработанное ведущим событие
+    uint16_t cursor = 0;                   // Номер следующей записи у ведущего
+    bool haveCursor = false;               // После сброса номер неизвестен – чтение без номера
+    uint16_t unacked = 0, stalled = 0;     // Чтения с записями без подтверждения, оставшиеся опросы паузы
+    for (uint32_t poll = 0; poll < polls; ++poll)
+    {
+        for (int n = rand() % 3; n > 0; --n) // Писатель: 0..2 события за опрос
+        {
+            uint16_t before = log.nextSequence();
+            log.push(nextEvent);
+            if (log.nextSequence() != before)
+                ++result.produced;
+            else
+                ++result.dropped;
+            ++nextEvent; // Отброшенные события видны ведущему как пропуск, учтённый счётчиком потерь
+        }
+        if (scenario.resetEvery && (poll + 1) % scenario.resetEvery == 0)
+            haveCursor = false, unacked = 0;
+        if (scenario.stallEvery && poll % scenario.stallEvery == 0)
+            stalled = 100;
+        if (stalled)
+        {
+            --stalled;
+            continue;
+        }
+
+        uint32_t out[EVENTS_PER_READ];
+        uint16_t first;
+        uint8_t count = log.read(haveCursor ? cursor : log.oldestSequence(), out, EVENTS_PER_READ, first);
+        ++result.reads;
+        if ((uint32_t)rand() % 100 < scenario.lostResponsePercent)
+        {
+            ++result.lostReads;
+            continue;
+        }
+        if (haveCursor && count && first != cursor)
+            ++result.errors; // Запись, которую ведущий ещё не получил, удалена
+        for (uint8_t i = 0; i < count; ++i)
+        {
+            if ((int64_t)out[i] <= lastProcessed)
+                ++result.duplicates;
+            else
+                ++result.delivered, result.gaps += out[i] - lastProcessed - 1, lastProcessed = out[i];
+            if (i && out[i] <= out[i - 1])
+                ++result.errors;
+        }
+        cursor = first + count, haveCursor = true;
+        if (count)
+            ++unacked;
+        if (unacked && (unacked >= scenario.ackEvery || !count)   // Новых записей нет – подтверждение сразу
+            && (uint32_t)rand() % 100 >= scenario.lostAckPercent) // Неподтверждённая запись (NACK) повторяется
+        {
+            unacked = 0;
+            uint16_t seq = cursor - 1;
+            CHECK(log.acknowledge(seq) && log.oldestSequence() == cursor);
+            CHECK(!log.acknowledge(seq)); // Повтор подтверждения игнорируется
+        }
+    }
+    for (int drain = 0; drain < 64; ++drain) // Остаток журнала без потерь
+    {
+        uint32_t out[EVENTS_PER_READ];
+        uint16_t first;
+        uint8_t count = log.read(haveCursor ? cursor : log.oldestSequence(), out, EVENTS_PER_READ, first);
+        cursor = first + count;
+        for (uint8_t i = 0; i < count; ++i)
+        {
+            if ((int64_t)out[i] <= lastProcessed)
+                ++result.duplicates;
+            else
+                ++result.delivered, result.gaps += out[i] - lastProcessed - 1, lastProcessed = out[i];
+        }
+        if (log.oldestSequence() != cursor)
+            log.acknowledge(cursor - 1);
+    }
+    CHECK(log.droppedCount() == (uint8_t)result.dropped);
+    CHECK(log.oldestSequence() == log.nextSequence() && log.nextSequence() == (uint16_t)result.produced);
+    result.gaps += nextEvent - 1 - lastProcessed; // Отброшенные после последней обработанной записи
+    return result;
+}
+
+int main()
+{
+    srand(1);
+    { // Граничные случаи номеров: чтение вне неподтверждённых записей – с самой старой, подтверждение вне – отказ
+        Log log;
+        uint16_t first;
+        uint32_t out[EVENTS_PER_READ];
+        CHECK(log.read(5, out, EVENTS_PER_READ, first) == 0 && first == 0);
+        for (uint32_t i = 0; i < 40; ++i)
+            log.push(i);
+        CHECK(log.nextSequence() == 32 && log.droppedCount() == 8);
+        CHECK(!log.acknowledge(32) && log.acknowledge(9) && !log.acknowledge(5));
+        CHECK(log.read(3, out, EVENTS_PER_READ, first) == 3 && first == 10 && out[0] == 10);
+        CHECK(log.read(31, out, EVENTS_PER_READ, first) == 1 && first == 31 && out[0] == 31);
+        CHECK(log.read(32, out, EVENTS_PER_READ, first) == 0 && first == 32);
+    }
+
+    static const Scenario scenarios[] = {
+        {"без потерь", 0, 0, 1, 0, 0},
+        {"потери ответов 30 %, подтверждений 50 %", 30, 50, 1, 0, 0},
+        {"конвейер: подтверждение раз в 4 чтения", 20, 20, 4, 0, 0},
+        {"сбросы ведущего", 20, 20, 2, 997, 0},
+        {"паузы ведущего (переполнение)", 10, 10, 1, 0, 1000},
+    };
+    const uint32_t polls = 200000; // Более 65536 записей – номера переходят через 0
+    for (const Scenario &scenario : scenarios)
+    {
+        Result r = run(scenario, polls);
+        printf("%s: записей %u, обработано %u, повторов %u, отброшено %u, ошибок %u, потеряно ответов %u из %u\n",
+               scenario.name, r.produced, r.delivered, r.duplicates, r.dropped, r.errors, r.lostReads, r.reads);
+        CHECK(r.produced > 65536 && r.errors == 0);
+        CHECK(r.delivered == r.produced && r.gaps == r.dropped); // Каждая принятая запись обработана ровно один раз
+        CHECK(r.duplicates <= (scenario.resetEvery ? polls / scenario.resetEvery * 32 : 0)); // Повторы – только после сброса
+        CHECK(!scenario.stallEvery || r.dropped > 0);
+    }
+    return hostTestResult();
+}
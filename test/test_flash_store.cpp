@@ -0,0 +1,240 @@
+/**
+ * @file test_flash_store.cpp
+ * @brief Моделирование FlashStore на модели flash STM32F1: износ и выравнивание стираний по страницам, худшая
+ * остановка service(), отложенное стирание при занятой шине и сохранность значений при отключении питания
+ * на любой операции с flash.
+ *
+ * Модель flash: запись полуслова только сбрасывает биты (52 мкс), стирание страницы устанавливает все биты (20 мс) –
+ * типовые времена из документации STM32F103. Время операций добавляется к DWT->CYCCNT (72 МГц), поэтому
+ * статистика хранилища считает остановку так же, как на устройстве. Отключение питания прерывает операцию:
+ * прерванная запись сбрасывает случайную часть битов, прерванное стирание устанавливает случайную часть битов.
+ */
+
+#include <map>
+#include "HostTest.h"
+#include "FlashStore.h"
+
+static const uint32_t PAGE0 = 0x0800F800, PAGE1 = 0x0800FC00; // Как в прошивке (bluepill_f103c8)
+static const uint32_t PROGRAM_US = 52, ERASE_US = 20000;
+
+struct PowerCut {}; ///< Отключение питания во время операции с flash.
+
+/**
+ * @brief Модель двух страниц flash с подсчётом операций и отключением питания после заданного числа операций.
+ */
+struct MockFlash
+{
+    static const uint16_t PAGE_SIZE = FLASH_PAGE_SIZE;
+
+    static inline uint16_t cells[2][PAGE_SIZE / 2]; ///< Содержимое страниц.
+    static inline uint32_t erases[2];               ///< Стирания по страницам.
+    static inline uint32_t programs;                ///< Записи полуслов.
+    static inline int32_t opsBeforeCut = -1;        ///< Операций до отключения питания (-1 – без отключения).
+
+    static uint16_t &cell(uint32_t address) { return cells[address >= PAGE1][(address - (address >= PAGE1 ? PAGE1 : PAGE0)) / 2]; }
+    static uint16_t read(uint32_t address) { return cell(address); }
+    static bool isFree(uint32_t) { return true; }
+
+    static void erase(uint32_t address)
+    {
+        uint16_t *page = cells[address >= PAGE1];
+        if (cut())
+        {
+            for (uint16_t i = 0; i < PAGE_SIZE / 2; ++i)
+                page[i] |= rand() & rand();
+            throw PowerCut();
+        }
+        for (uint16_t i = 0; i < PAGE_SIZE / 2; ++i)
+            page[i] = 0xFFFF;
+        ++erases[address >= PAGE1], elapse(ERASE_US);
+    }
+
+    static void program(uint32_t address, uint16_t value)
+    {
+        uint16_t &target = cell(address);
+        CHECK(target == 0xFFFF || value == 0x0000); // Запись только в стёртую ячейку (или обнуление)
+        if (cut())
+        {
+            target &= value | (uint16_t)rand();
+            throw PowerCut();
+        }
+        target &= value, ++programs, elapse(PROGRAM_US);
+    }
+
+    static bool cut() { return opsBeforeCut >= 0 && opsBeforeCut-- == 0; }
+    static void elapse(uint32_t us) { DWT->CYCCNT += us * (SystemCoreClock / 1000000); }
+    static void scramble() ///< @brief Случайное содержимое страниц (flash, никогда не использовавшаяся хранилищем).
+    {
+        for (auto &page : cells)
+            for (uint16_t &c : page)
+                c = rand();
+    }
+};
+
+static const uint8_t KEYS = 16; // SETTING_COUNT прошивки
+typedef FlashStore<MockFlash, KEYS> Store;
+
+static uint32_t totalErases() { return MockFlash::erases[0] + MockFlash::erases[1]; }
+
+/**
+ * @brief Худшие длительности вызовов service(), мкс (по DWT->CYCCNT).
+ */
+struct Stalls
+{
+    uint32_t erase = 0; ///< Вызовы со стиранием страницы.
+    uint32_t other = 0; ///< Остальные вызовы (запись, копирование записи или заголовок при уплотнении).
+};
+
+/**
+ * @brief Вызывает service(), пока все ожидающие ключи не записаны во flash.
+ */
+static void flush(Store &store, bool mayErase, Stalls &stalls)
+{
+    for (Store::Stats stats; store.readStats(stats), stats.pending;)
+    {
+        uint32_t start = DWT->CYCCNT, erased = totalErases();
+        store.service(mayErase);
+        uint32_t us = (DWT->CYCCNT - start) / (SystemCoreClock / 1000000);
+        uint32_t &worst = totalErases() != erased ? stalls.erase : stalls.other;
+        worst = max(worst, us);
+    }
+}
+
+static void flush(Store &store, bool mayErase = true)
+{
+    Stalls stalls;
+    flush(store, mayErase, stalls);
+}
+
+int main()
+{
+    srand(1);
+    { // Износ: одно стирание на SLOTS - KEYS записей, страницы стираются по очереди; худшая остановка – стирание
+        MockFlash::scramble();
+        Store store(PAGE0, PAGE1);
+        CHECK(store.begin());
+        uint32_t formatErases = totalErases();
+        MockFlash::erases[0] = MockFlash::erases[1] = 0;
+        const uint32_t writes = 100000;
+        Stalls stalls;
+        for (uint32_t i = 0; i < writes; ++i)
+            store.write(rand() % KEYS, i), flush(store, true, stalls);
+        uint32_t erased = totalErases();
+        printf("Запуск на случайной flash: стираний %u\n", formatErases);
+        printf("Записей %u: стираний %u (%u и %u по страницам), одно стирание на %.1f записей\n",
+               writes, erased, MockFlash::erases[0], MockFlash::erases[1], (double)writes / erased);
+        printf("Худшая остановка service(): %u мкс (статистика хранилища – %u мкс), без стирания – %u мкс\n",
+               stalls.erase, store.maxStallUs(), stalls.other);
+        // Страница заполняется за SLOTS записей, каждое уплотнение освобождает SLOTS - KEYS ячеек и поглощает запись,
+        // вызвавшую его; первое уплотнение пишет в страницу, стёртую при форматировании
+        CHECK(erased == (writes - Store::SLOTS - 1) / (Store::SLOTS - KEYS + 1));
+        CHECK(abs((int)MockFlash::erases[0] - (int)MockFlash::erases[1]) <= 1);
+        CHECK(store.maxStallUs() == ERASE_US && stalls.erase == ERASE_US);
+        CHECK(stalls.other == 3 * PROGRAM_US); // Худший вызов без стирания – заголовок страницы (записи – по одной)
+    }
+
+    { // Занятая шина: стирание откладывается, значения доступны из RAM, после освобождения шины записываются
+        MockFlash::scramble();
+        Store store(PAGE0, PAGE1);
+        store.begin();
+        Store::Stats stats;
+        for (uint16_t i = 0; i <= Store::SLOTS; ++i) // Одно уплотнение: другая страница содержит записи
+            store.write(i % KEYS, i), flush(store);
+        uint32_t erased = totalErases();
+        for (uint16_t i = 0; store.readStats(stats), stats.used < Store::SLOTS; ++i) // Заполнение активной страницы
+            store.write(i % KEYS, i), flush(store, false);
+        CHECK(totalErases() == erased);
+        for (uint8_t key = 0; key < KEYS; ++key)
+            store.write(key, 0xA500 + key);
+        for (int tick = 0; tick < 1000; ++tick)
+            store.service(false);
+        store.readStats(stats);
+        uint16_t value;
+        CHECK(totalErases() == erased && stats.pending == KEYS);
+        CHECK(store.read(7, value) && value == 0xA507);
+        Stalls stalls;
+        flush(store, true, stalls);
+        store.readStats(stats);
+        CHECK(totalErases() == erased + 1 && stats.pending == 0 && stalls.erase == ERASE_US);
+        Store reloaded(PAGE0, PAGE1);
+        reloaded.begin();
+        CHECK(reloaded.read(7, value) && value == 0xA507 && reloaded.read(15, value) && value == 0xA50F);
+        printf("Занятая шина: 1000 вызовов service(false) без стирания, %u ключей ожидали записи\n", KEYS);
+    }
+
+    { // Запись во время уплотнения: ключ, изменённый после копирования, остаётся ожидающим и записывается после него
+        MockFlash::scramble();
+        Store store(PAGE0, PAGE1);
+        store.begin();
+        Store::Stats stats;
+        for (uint16_t i = 0; store.readStats(stats), stats.used < Store::SLOTS; ++i)
+            store.write(i % KEYS, i), flush(store);
+        store.write(0, 0x1111);
+        uint32_t generation = stats.generation;
+        for (int call = 0; call < 4; ++call) // Стирание и копирование ключей 0..2
+            store.service(true);
+        store.write(1, 0x2222);
+        flush(store);
+        store.readStats(stats);
+        CHECK(stats.generation == generation + 1 && stats.pending == 0 && stats.used == KEYS + 1);
+        Store reloaded(PAGE0, PAGE1);
+        reloaded.begin();
+        uint16_t value;
+        CHECK(reloaded.read(0, value) && value == 0x1111 && reloaded.read(1, value) && value == 0x2222);
+    }
+
+    { // Отключение питания на случайной операции: после перезапуска каждый ключ – последнее записанное значение
+      // или значение, запись которого прервана
+        MockFlash::scramble();
+        std::map<uint8_t, uint16_t> committed;
+        uint32_t cuts = 0, mismatches = 0;
+        const uint32_t rounds = 5000;
+        for (uint32_t round = 0; round < rounds; ++round)
+        {
+            MockFlash::opsBeforeCut = -1;
+            Store store(PAGE0, PAGE1);
+            store.begin();
+            for (uint8_t key = 0; key < KEYS; ++key)
+            {
+                uint16_t value;
+                bool has = store.read(key, value);
+                auto known = committed.find(key);
+                if (has != (known != committed.end()) || (has && value != known->second))
+                    ++mismatches;
+            }
+            MockFlash::opsBeforeCut = rand() % 1300;
+            Store running(PAGE0, PAGE1);
+            running.begin();
+            uint8_t key = 0;
+            uint16_t value = 0;
+            bool inFlight = false;
+            try
+            {
+                for (int i = 0; i < 600; ++i)
+                {
+                    key = rand() % KEYS, value = rand();
+                    inFlight = running.write(key, value);
+                    for (Store::Stats stats; running.readStats(stats), stats.pending;)
+                        running.service(rand() % 4 != 0); // Шина занята в четверти вызовов
+                    committed[key] = value, inFlight = false;
+                }
+            }
+            catch (PowerCut &)
+            {
+                ++cuts;
+            }
+            if (inFlight) // Прерванная запись: при запуске допустимо любое из двух значений
+            {
+                MockFlash::opsBeforeCut = -1;
+                Store probe(PAGE0, PAGE1);
+                probe.begin();
+                uint16_t stored;
+                if (probe.read(key, stored) && stored == value)
+                    committed[key] = value;
+            }
+        }
+        printf("Отключений питания: %u из %u циклов, расхождений после перезапуска: %u\n", cuts, rounds, mismatches);
+        CHECK(cuts > rounds / 2 && mismatches == 0);
+    }
+    return hostTestResult();
+}
@@ -0,0 +1,217 @@
+/**
+ * @file test_key_matrix.cpp
+ * @brief Моделирование сканирования KeyMatrix: фантомные нажатия, n-key rollover, события клавиш
+ * и предельная частота кадров 4x4 и 6x4.
+ *
+ * Модель матрицы вычисляет IDR порта по выбранной строке (последняя запись BSRR) и нажатым клавишам: без диодов
+ * столбец замыкается на выбранную строку и через цепочки нажатых клавиш других строк. Спад уровня столбца
+ * мгновенный (строка – выход с открытым стоком), нарастание – через подтяжку RC; пока напряжение ниже V_IH,
+ * отпущенный столбец читается как нажатый. Шаг сканирования читает столбцы через период шага после выбора строки,
+ * поэтому период шага не может быть меньше времени установления столбца.
+ */
+
+#include <math.h>
+#include "HostTest.h"
+#include "KeyMatrix.h"
+
+static const double PULLUP_KOHM = 50;     ///< Внутренняя подтяжка, худший случай по документации STM32F103 (30–50 кОм).
+static const double COLUMN_PF = 50;       ///< Ёмкость столбца с проводкой клавиатуры (с запасом).
+static const double VIH_RATIO = 0.555;    ///< V_IH / VDD для входа STM32F103 при 3.3 В (0.41 * (VDD - 2) + 1.3).
+static const uint32_t STEP_CYCLES = 140;  ///< Время шага на устройстве: ~40 тактов кода и ~100 тактов входа в прерывание
+                                          ///< HardwareTimer (измеряется на устройстве: KeyMatrix::maxStepCycles()).
+static const double CPU_BUDGET = 0.2;     ///< Допустимая доля процессорного времени на сканирование.
+
+static const uint8_t ROW_PINS[] = {PB12, PB13, PB14, PB15, PB10, PB11}; // Пины прошивки (main.cpp)
+static const uint8_t COL_PINS[] = {PB0, PB1, PB8, PB9};
+
+/**
+ * @brief Электрическая модель матрицы клавиш на порту GPIOB.
+ */
+template <uint8_t Rows, uint8_t Cols>
+struct MatrixModel
+{
+    bool diodes;             ///< Клавиши развязаны диодами.
+    uint32_t keys = 0;       ///< Нажатые клавиши (бит r * Cols + c).
+    double volts[Cols] = {}; ///< Напряжение столбцов в долях VDD.
+
+    explicit MatrixModel(bool diodes) : diodes(diodes) { std::fill(volts, volts + Cols, 1.0); }
+
+    int selectedRow() const
+    {
+        for (uint8_t r = 0; r < Rows; ++r)
+            if (GPIOB->BSRR & (digitalPinToBitMask(ROW_PINS[r]) << 16))
+                return r;
+        return -1;
+    }
+
+    /**
+     * @brief Столбцы, замкнутые на выбранную строку (с диодами – только напрямую).
+     */
+    uint32_t lowColumns() const
+    {
+        int row = selectedRow();
+        if (row < 0)
+            return 0;
+        uint32_t rows = 1UL << row, cols = 0, previous = ~0U;
+        while (rows != previous)
+        {
+            previous = rows;
+            for (uint8_t r = 0; r < Rows; ++r)
+                for (uint8_t c = 0; c < Cols; ++c)
+                    if (keys >> (r * Cols + c) & 1 && (rows >> r & 1))
+                        cols |= 1UL << c;
+            if (diodes)
+                break;
+            for (uint8_t r = 0; r < Rows; ++r)
+                for (uint8_t c = 0; c < Cols; ++c)
+                    if (keys >> (r * Cols + c) & 1 && (cols >> c & 1))
+                        rows |= 1UL << r;
+        }
+        return cols;
+    }
+
+    /**
+     * @brief Переходный процесс столбцов за время шага после выбора строки.
+     * @param us Время, мкс.
+     */
+    void settle(double us)
+    {
+        uint32_t low = lowColumns();
+        for (uint8_t c = 0; c < Cols; ++c)
+            volts[c] = (low >> c & 1) ? 0 : 1 - (1 - volts[c]) * exp(-us / (PULLUP_KOHM * COLUMN_PF * 1e-3));
+    }
+
+    void sample() const ///< @brief Выставляет IDR по напряжениям столбцов.
+    {
+        uint32_t idr = 0xFFFF;
+        for (uint8_t c = 0; c < Cols; ++c)
+            if (volts[c] < VIH_RATIO)
+                idr &= ~digitalPinToBitMask(COL_PINS[c]);
+        GPIOB->IDR = idr;
+    }
+};
+
+/**
+ * @brief Матрица с моделью: шаги сканирования по прерыванию TIM4 с заданным периодом.
+ */
+template <uint8_t Rows, uint8_t Cols>
+struct MatrixBench
+{
+    KeyMatrix<Rows, Cols> matrix;
+    MatrixModel<Rows, Cols> model;
+
+    MatrixBench(bool diodes) : matrix(ROW_PINS, COL_PINS, 50000, 500000, diodes), model(diodes)
+    {
+        matrix.begin(TIM4, 1000);
+        model.settle(1e3);
+    }
+
+    uint32_t frame(double stepUs) ///< @brief Сканирует полный кадр. @return Кадр KeyMatrix.
+    {
+        for (uint8_t i = 0; i < Rows; ++i)
+        {
+            model.sample();
+            hostTimerInterrupt(TIM4);
+            model.settle(stepUs);
+        }
+        return matrix.state();
+    }
+};
+
+/**
+ * @brief Количество ошибочных кадров на случайной последовательности нажатий (с диодами) при заданном периоде шага.
+ */
+template <uint8_t Rows, uint8_t Cols>
+static uint32_t misreadFrames(double stepUs)
+{
+    MatrixBench<Rows, Cols> bench(true);
+    srand(1);
+    uint32_t errors = 0;
+    for (int i = 0; i < 3000; ++i)
+    {
+        bench.model.keys ^= 1UL << (rand() % (Rows * Cols));
+        bench.frame(stepUs);
+        errors += bench.frame(stepUs) != bench.model.keys; // Первый кадр после изменения может застать его посередине
+    }
+    return errors;
+}
+
+/**
+ * @brief Находит наименьший период шага без ошибок чтения и печатает предельные частоты кадров.
+ */
+template <uint8_t Rows, uint8_t Cols>
+static void reportScanRate()
+{
+    double settleUs = 0.25;
+    while (misreadFrames<Rows, Cols>(settleUs))
+        settleUs += 0.25;
+    double cpuStepUs = STEP_CYCLES * 1e6 / SystemCoreClock;
+    double budgetStepUs = max(settleUs, cpuStepUs / CPU_BUDGET);
+    MatrixBench<Rows, Cols> bench(true);
+    double hostNs = hostNanosecondsPerCall(1000000, [&](uint32_t i) { GPIOB->IDR = i; hostTimerInterrupt(TIM4); });
+    printf("%ux%u: установление столбца %.2f мкс, шаг на устройстве %.2f мкс (%u тактов); кадр %u шагов\n",
+           Rows, Cols, settleUs, cpuStepUs, STEP_CYCLES, Rows);
+    printf("     предел кадров: %.1f кГц (100 %% ЦП), %.1f кГц при %.0f %% ЦП; шаг на хосте %.1f нс\n",
+           1e3 / (Rows * max(settleUs, cpuStepUs)), 1e3 / (Rows * budgetStepUs), CPU_BUDGET * 100, hostNs);
+    CHECK(misreadFrames<Rows, Cols>(settleUs - 0.25) > 0); // Модель установления действительно ограничивает шаг
+}
+
+int main()
+{
+    { // Без диодов: три угла прямоугольника дают фантомное нажатие четвёртого
+        MatrixBench<4, 4> bench(false);
+        bench.model.keys = 1 << 0 | 1 << 3; // (0,0), (0,3)
+        bench.frame(10);
+        CHECK(bench.frame(10) == (1 << 0 | 1 << 3));
+        bench.model.keys |= 1 << 8; // (2,0): строка 2 через (0,0) и (0,3) видит и (2,3)
+        bench.frame(10);
+        CHECK(bench.frame(10) == (1 << 0 | 1 << 3)); // Новые нажатия в прямоугольнике не принимаются
+        CHECK(bench.matrix.ghostFrameCount() > 0);
+        bench.model.keys &= ~1UL; // Отпускание (0,0) снимает неоднозначность
+        bench.frame(10);
+        CHECK(bench.frame(10) == (1 << 3 | 1 << 8));
+        bench.model.keys = 1 << 0 | 1 << 5 | 1 << 10 | 1 << 15; // Диагональ – без общих столбцов
+        bench.frame(10);
+        CHECK(bench.frame(10) == bench.model.keys);
+    }
+    { // С диодами: n-key rollover
+        MatrixBench<6, 4> bench(true);
+        for (uint8_t i = 0; i < 24; ++i)
+        {
+            bench.model.keys |= 1UL << i;
+            bench.frame(10);
+            CHECK(bench.frame(10) == bench.model.keys);
+        }
+        CHECK(bench.matrix.ghostFrameCount() == 0);
+    }
+    { // Дребезг, кратковременное и длительное нажатие через ButtonHandler (кадры 1 кГц)
+        MatrixBench<4, 4> bench(false);
+        uint32_t shortPresses[16] = {}, longPresses[16] = {};
+        auto run = [&](uint32_t ms, uint32_t keys, uint32_t bounceMs) {
+            for (uint32_t t = 0; t < ms; ++t)
+            {
+                bench.model.keys = (t < bounceMs && t % 2) ? 0 : keys;
+                bench.frame(250);
+                hostMicros += 1000;
+                bench.matrix.updateState(hostMicros);
+                for (uint8_t i = 0; i < 16; ++i)
+                    shortPresses[i] += bench.matrix.key(i).isShortPress(), longPresses[i] += bench.matrix.key(i).isLongPress();
+            }
+        };
+        run(100, 0, 0);
+        run(150, 1 << 6, 4); // (1,2): 150 мс с дребезгом 4 мс
+        run(100, 0, 4);
+        run(700, 1 << 6 | 1 << 9, 3); // (1,2) и (2,1) – 700 мс
+        run(100, 0, 3);
+        CHECK(shortPresses[6] == 1 && longPresses[6] == 1 && longPresses[9] == 1);
+        uint32_t others = 0;
+        for (uint8_t i = 0; i < 16; ++i)
+            others += (i != 6) * shortPresses[i] + (i != 6 && i != 9) * longPresses[i];
+        CHECK(others == 0);
+    }
+
+    printf("Модель: подтяжка %.0f кОм, столбец %.0f пФ, V_IH %.3f VDD\n", PULLUP_KOHM, COLUMN_PF, VIH_RATIO);
+    reportScanRate<4, 4>();
+    reportScanRate<6, 4>();
+    return hostTestResult();
+}
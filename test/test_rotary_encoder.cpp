@@ -0,0 +1,216 @@
+/**
+ * @file test_rotary_encoder.cpp
+ * @brief Моделирование RotaryEncoder: таймер TIM1 в режиме энкодера с цифровым фильтром, дребезг контактов,
+ * быстрое вращение, редкий опрос и переполнение 16-битного счётчика.
+ *
+ * Модель таймера читает настройку из регистров TIM1 (режим SMCR, код фильтра CCMR1) и ведёт TIM1->CNT так же,
+ * как аппаратный счётчик в режиме 3: каждый фронт отфильтрованного сигнала любого канала даёт ±1 по направлению
+ * квадратуры. Цифровой фильтр пропускает уровень, продержавшийся N отсчётов с частотой fDTS / делитель
+ * (непрерывное приближение без учёта фазы отсчётов). Щелчки опрашиваются takeDetents() в случайные моменты;
+ * сумма всех ответов должна совпасть с числом сделанных щелчков.
+ */
+
+#include <math.h>
+#include <vector>
+#include "HostTest.h"
+#include "RotaryEncoder.h"
+
+/**
+ * @brief Фронт сигнала канала энкодера.
+ */
+struct Edge
+{
+    double us;       ///< Время, мкс.
+    uint8_t channel; ///< 0 – канал A (TI1), 1 – канал B (TI2).
+    bool level;      ///< Новый уровень.
+};
+
+/**
+ * @brief Модель TIM1 в режиме энкодера.
+ */
+struct TimerModel
+{
+    bool raw[2] = {true, true};      ///< Уровни на входах (в положении щелчка оба канала отпущены).
+    bool filtered[2] = {true, true}; ///< Уровни после цифрового фильтра.
+    double since[2] = {};            ///< Время последнего изменения уровня на входе.
+    uint32_t transitions = 0;        ///< Все изменения счётчика (включая взаимно компенсирующиеся).
+
+    /**
+     * @brief Время, которое уровень должен продержаться, чтобы пройти фильтр (RM0008, TIMx_CCMR1.IC1F, CKD = 0).
+     */
+    double filterUs() const
+    {
+        static const uint8_t divider[16] = {1, 1, 1, 1, 2, 2, 4, 4, 8, 8, 16, 16, 16, 32, 32, 32};
+        static const uint8_t samples[16] = {0, 2, 4, 8, 6, 8, 6, 8, 6, 8, 5, 6, 8, 5, 6, 8};
+        uint8_t code = (TIM1->CCMR1 >> TIM_CCMR1_IC1F_Pos) & 0x0F;
+        return samples[code] * divider[code] * 1e6 / SystemCoreClock;
+    }
+
+    /**
+     * @brief Пропускает через фильтр уровни, установившиеся к моменту времени.
+     */
+    void advance(double us)
+    {
+        for (;;)
+        {
+            int next = -1;
+            double at = us;
+            for (uint8_t ch = 0; ch < 2; ++ch)
+                if (raw[ch] != filtered[ch] && since[ch] + filterUs() <= at)
+                    next = ch, at = since[ch] + filterUs();
+            if (next < 0)
+                return;
+            count(next);
+        }
+    }
+
+    void edge(const Edge &e) ///< @brief Изменяет уровень на входе.
+    {
+        advance(e.us);
+        raw[e.channel] = e.level, since[e.channel] = e.us;
+        advance(e.us);
+    }
+
+    /**
+     * @brief Фронт отфильтрованного сигнала: ±1 к счётчику по квадратуре (A опережает B – счёт вверх).
+     */
+    void count(uint8_t ch)
+    {
+        static const uint8_t phase[4] = {2, 1, 3, 0}; // Положение в последовательности 11 -> 01 -> 00 -> 10 по состоянию A:B
+        uint8_t before = phase[filtered[0] << 1 | filtered[1]];
+        filtered[ch] = raw[ch];
+        uint8_t after = phase[filtered[0] << 1 | filtered[1]];
+        if (!(TIM1->CR1 & TIM_CR1_CEN) || (TIM1->SMCR & TIM_SMCR_SMS) != (TIM_SMCR_SMS_0 | TIM_SMCR_SMS_1))
+            return;
+        TIM1->CNT = (TIM1->CNT + (((after - before) & 3) == 1 ? 1 : 0xFFFF)) & 0xFFFF;
+        ++transitions;
+    }
+};
+
+/**
+ * @brief Профиль вращения и дребезга.
+ */
+struct Profile
+{
+    const char *name;
+    double stepMinUs, stepMaxUs; ///< Интервал между фронтами квадратуры.
+    uint8_t maxGlitches;         ///< Наибольшее число ложных импульсов после фронта.
+    double glitchMaxUs;          ///< Наибольшая длительность ложного импульса и паузы между ними.
+};
+
+static double uniform(double low, double high) { return low + (high - low) * rand() / RAND_MAX; }
+
+/**
+ * @brief Фронты вращения на заданное число щелчков (4 фронта квадратуры на щелчок) с дребезгом.
+ */
+static void turn(std::vector<Edge> &edges, double &us, int32_t detents, const Profile &profile)
+{
+    static bool level[2] = {true, true};
+    for (int32_t step = 0; step < abs(detents) * 4; ++step)
+    {
+        us += uniform(profile.stepMinUs, profile.stepMaxUs);
+        uint8_t ch = (step % 2) ^ (detents < 0); // По часовой стрелке первым меняется канал A
+        level[ch] = !level[ch];
+        double t = us;
+        edges.push_back({t, ch, level[ch]});
+        for (uint8_t g = rand() % (profile.maxGlitches + 1); g; --g)
+        {
+            edges.push_back({t += uniform(0.1, profile.glitchMaxUs), ch, !level[ch]});
+            edges.push_back({t += uniform(0.1, profile.glitchMaxUs), ch, level[ch]});
+        }
+    }
+}
+
+/**
+ * @brief Результат прогона.
+ */
+struct Result
+{
+    int32_t detents;      ///< Сумма ответов takeDetents().
+    uint32_t transitions; ///< Изменения счётчика.
+    uint32_t polls;       ///< Число опросов.
+    int8_t maxAnswer;     ///< Наибольший по модулю ответ.
+};
+
+/**
+ * @brief Подаёт фронты на модель и опрашивает энкодер в случайные моменты.
+ * @param filter Код цифрового фильтра энкодера.
+ * @param pollMinUs, pollMaxUs Интервал между опросами.
+ */
+static Result run(const std::vector<Edge> &edges, uint8_t filter, double pollMinUs, double pollMaxUs)
+{
+    RotaryEncoder encoder(TIM1, PA8, PA9, 4, filter);
+    encoder.begin();
+    TimerModel model;
+    Result result = {};
+    auto poll = [&](double us) {
+        model.advance(us);
+        int8_t answer = encoder.takeDetents();
+        result.detents += answer, ++result.polls;
+        if (abs(answer) > abs(result.maxAnswer))
+            result.maxAnswer = answer;
+        return answer;
+    };
+    double nextPoll = uniform(pollMinUs, pollMaxUs);
+    for (const Edge &e : edges)
+    {
+        for (; nextPoll < e.us; nextPoll += uniform(pollMinUs, pollMaxUs))
+            poll(nextPoll);
+        model.edge(e);
+    }
+    double end = edges.back().us + 1e4;
+    while (poll(end)) // Остаток, не поместившийся в последний ответ
+        ;
+    result.transitions = model.transitions;
+    return result;
+}
+
+int main()
+{
+    static const Profile profiles[] = {
+        {"медленно, дребезг контактов до 0.3 мс", 500, 5000, 6, 25},
+        {"быстро (до 5000 щелчков/с), короткие помехи", 50, 100, 3, 1},
+        {"быстро, без дребезга", 20, 40, 0, 0},
+    };
+    srand(1);
+    printf("Фильтр 0x0F: %.2f мкс\n", (TIM1->CCMR1 = 0x0F << TIM_CCMR1_IC1F_Pos, TimerModel().filterUs()));
+    for (const Profile &profile : profiles)
+    {
+        std::vector<Edge> edges;
+        double us = 0;
+        int32_t expected = 0;
+        uint32_t ideal = 0; // Изменения счётчика без дребезга
+        for (int i = 0; i < 300; ++i)
+        {
+            int32_t detents = (rand() % 2 ? 1 : -1) * (1 + rand() % 8);
+            turn(edges, us, detents, profile);
+            expected += detents, ideal += abs(detents) * 4;
+            us += uniform(0, 20000);
+        }
+        for (uint8_t filter : {0, 0x0F})
+        {
+            Result result = run(edges, filter, 1000, 20000);
+            printf("%-46s фильтр 0x%02X: щелчков %d из %d, лишних изменений счётчика %u из %u, опросов %u\n",
+                   profile.name, filter, (int)result.detents, (int)expected,
+                   result.transitions - ideal, result.transitions, result.polls);
+            CHECK(result.detents == expected); // Дребезг одного канала компенсируется квадратурой, щелчки не теряются
+            if (filter && profile.glitchMaxUs * 2 < TimerModel().filterUs())
+                CHECK(result.transitions == ideal); // Короткие помехи фильтр подавляет полностью
+        }
+    }
+    { // Редкий опрос: ответы ограничены ±127, остаток переносится; счётчик переполняется в обе стороны.
+      // Между опросами накапливается до 1000 щелчков (предел переноса – 8191 щелчок, половина 16-битного счётчика)
+        std::vector<Edge> edges;
+        double us = 0;
+        for (int i = 0; i < 40; ++i)
+            turn(edges, us, 1000, profiles[2]), us += 300000;
+        for (int i = 0; i < 60; ++i)
+            turn(edges, us, -1000, profiles[2]), us += 300000;
+        Result result = run(edges, 0x0F, 30000, 30000);
+        printf("редкий опрос (30 мс): щелчков %d из -20000, наибольший ответ %d, опросов %u\n",
+               (int)result.detents, result.maxAnswer, result.polls);
+        CHECK(result.detents == -20000);
+        CHECK(abs(result.maxAnswer) == 127);
+    }
+    return hostTestResult();
+}
@@ -0,0 +1,147 @@
+/**
+ * @file test_shift_register_panel.cpp
+ * @brief Моделирование ShiftRegisterPanel на SPI2: цепочки 74HC595 и 74HC165, порядок байтов выходов, выборка
+ * входов, задержка выходов на одно обновление, фильтрация дребезга клавиш и настройка SPI и DMA.
+ *
+ * Модель цепочек выполняет передачу, запущенную refresh(), по регистрам каналов DMA (CMAR, CNDTR): байты памяти
+ * передачи сдвигаются в 74HC595 старшим битом вперёд (SPI, режим 0), а в память приёма попадают биты, выдвигаемые
+ * цепочкой 74HC165 (вход SER дальнего регистра подтянут к питанию). Импульс защёлки восстанавливается
+ * по последней записи в BSRR (refresh() оставляет защёлку в высоком уровне): загрузка входов 74HC165 и вывод
+ * данных предыдущей передачи на 74HC595.
+ */
+
+#include "HostTest.h"
+#include "ShiftRegisterPanel.h"
+
+static const uint8_t BYTES = 4;
+typedef ShiftRegisterPanel<BYTES> Panel;
+
+/**
+ * @brief Модель цепочек 74HC595 (выходы) и 74HC165 (входы); индекс 0 – ближний к микроконтроллеру регистр.
+ */
+struct ChainModel
+{
+    uint8_t shift595[BYTES] = {};         ///< Сдвиговые регистры 74HC595.
+    uint8_t storage595[BYTES] = {};       ///< Регистры хранения 74HC595 (выходы Q0..Q7).
+    uint8_t inputs165[BYTES] = {0xFF, 0xFF, 0xFF, 0xFF}; ///< Уровни на входах D0..D7 74HC165 (подтяжка к питанию).
+    uint8_t shift165[BYTES] = {};         ///< Сдвиговые регистры 74HC165.
+    uint32_t transfers = 0;               ///< Выполненные передачи.
+
+    /**
+     * @brief Сдвигает один бит по обеим цепочкам.
+     * @param mosi Бит, выдаваемый SPI.
+     * @return Бит на MISO (выход QH ближнего 74HC165) до сдвига.
+     */
+    bool clock(bool mosi)
+    {
+        bool miso = shift165[0] >> 7 & 1;
+        for (uint8_t i = BYTES; i-- > 0;) // Бит уходит от ближнего 74HC595 к дальнему
+            shift595[i] = shift595[i] << 1 | (i ? shift595[i - 1] >> 7 & 1 : mosi);
+        for (uint8_t i = 0; i < BYTES; ++i) // Бит приходит от дальнего 74HC165 к ближнему
+            shift165[i] = shift165[i] << 1 | (i + 1 < BYTES ? shift165[i + 1] >> 7 & 1 : 1);
+        return miso;
+    }
+
+    /**
+     * @brief Выполняет запущенную refresh() передачу: импульс защёлки, затем обмен CNDTR байт по DMA.
+     */
+    void transfer()
+    {
+        DMA_Channel_TypeDef *rx = DMA1_Channel4, *tx = DMA1_Channel5;
+        if (!(tx->CCR & DMA_CCR_EN) || !(rx->CCR & DMA_CCR_EN) || !tx->CNDTR)
+            return;
+        if (GPIOB->BSRR == digitalPinToBitMask(PB12)) // Защёлка: SH/LD = 0 загружает 74HC165, фронт RCLK выводит 74HC595
+        {
+            memcpy(storage595, shift595, BYTES);
+            memcpy(shift165, inputs165, BYTES);
+        }
+        const uint8_t *txMemory = (const uint8_t *)(uintptr_t)tx->CMAR;
+        uint8_t *rxMemory = (uint8_t *)(uintptr_t)rx->CMAR;
+        for (uint32_t n = 0; tx->CNDTR; ++n)
+        {
+            uint8_t out = txMemory[n], in = 0;
+            for (uint8_t bit = 8; bit-- > 0;)
+                in = in << 1 | clock(out >> bit & 1);
+            SPI2->DR = in;
+            rxMemory[n] = SPI2->DR;
+            --tx->CNDTR, --rx->CNDTR;
+        }
+        ++transfers;
+    }
+};
+
+int main()
+{
+    Panel &panel = *hostSram<Panel>(SPI2, DMA1_Channel4, DMA1_Channel5, PB13, PB14, PB15, PB12, 500000);
+    panel.begin();
+    ChainModel chain;
+
+    { // Настройка: SPI2 – ведущий, режим 0, fPCLK1 / 8; DMA из SPI2->DR в память и обратно
+        CHECK((RCC->APB1ENR & RCC_APB1ENR_SPI2EN) && (RCC->AHBENR & RCC_AHBENR_DMA1EN));
+        CHECK((SPI2->CR1 & (SPI_CR1_MSTR | SPI_CR1_SPE | SPI_CR1_SSM | SPI_CR1_SSI)) == (SPI_CR1_MSTR | SPI_CR1_SPE | SPI_CR1_SSM | SPI_CR1_SSI));
+        CHECK(!(SPI2->CR1 & (SPI_CR1_CPOL | SPI_CR1_CPHA | SPI_CR1_LSBFIRST)));
+        CHECK(SPI2->CR2 == (SPI_CR2_RXDMAEN | SPI_CR2_TXDMAEN));
+        CHECK(DMA1_Channel4->CPAR == (uintptr_t)&SPI2->DR && DMA1_Channel5->CPAR == (uintptr_t)&SPI2->DR);
+        CHECK((GPIOB->CRH >> 20 & 0xF) == 0xB && (GPIOB->CRH >> 28 & 0xF) == 0xB); // PB13 (SCK), PB15 (MOSI) – альтернативная функция
+        uint32_t spiHz = 36000000 >> ((SPI2->CR1 >> SPI_CR1_BR_Pos & 7) + 1);
+        printf("SPI2: %.2f МГц, передача %u байт – %.1f мкс\n", spiHz / 1e6, BYTES, BYTES * 8 * 1e6 / spiHz);
+    }
+
+    { // Выходы: регистр k получает outputs[k] на следующем обновлении
+        static const uint8_t first[BYTES] = {0x01, 0x80, 0xA5, 0x3C}, second[BYTES] = {0xFF, 0x00, 0x5A, 0xC3};
+        for (uint8_t k = 0; k < BYTES; ++k)
+            panel.setOutputs(k, first[k]);
+        CHECK(panel.refresh());
+        CHECK(DMA1_Channel4->CCR == (DMA_CCR_MINC | DMA_CCR_EN) && DMA1_Channel5->CCR == (DMA_CCR_MINC | DMA_CCR_DIR | DMA_CCR_EN));
+        CHECK(DMA1_Channel5->CNDTR == BYTES);
+        CHECK(!panel.refresh()); // Передача не завершена – обновление пропускается
+        chain.transfer();
+        CHECK(chain.storage595[0] == 0 && chain.storage595[3] == 0); // Ещё не защёлкнуты
+        for (uint8_t k = 0; k < BYTES; ++k)
+            panel.setOutputs(k, second[k]);
+        CHECK(panel.refresh());
+        chain.transfer();
+        CHECK(memcmp(chain.storage595, first, BYTES) == 0);
+        CHECK(panel.refresh());
+        chain.transfer();
+        CHECK(memcmp(chain.storage595, second, BYTES) == 0);
+    }
+
+    { // Входы: бит b байта i – вход Db i-го 74HC165, клавиша i * 8 + b; фильтр – 4 обновления
+        static const uint8_t pressed[BYTES] = {0x01, 0x80, 0x24, 0x00}; // Нажатые клавиши замыкают вход на землю
+        for (uint8_t i = 0; i < BYTES; ++i)
+            chain.inputs165[i] = ~pressed[i];
+        uint32_t expected = 0;
+        for (uint8_t i = 0; i < BYTES; ++i)
+            expected |= (uint32_t)pressed[i] << (8 * i);
+        auto pressedKeys = [&](uint32_t ms) {
+            hostMicros = ms * 1000ULL;
+            panel.refresh(), chain.transfer(), panel.updateState(hostMicros);
+            uint32_t keys = 0;
+            for (uint8_t k = 0; k < Panel::KEY_COUNT; ++k)
+                keys |= (uint32_t)panel.key(k).isPressedNow() << k;
+            return keys;
+        };
+        uint32_t ms = 100;
+        uint32_t afterThree = (pressedKeys(ms++), pressedKeys(ms++), pressedKeys(ms++));
+        uint32_t settled = (pressedKeys(ms++), pressedKeys(ms++));
+        printf("Клавиши: после 3 обновлений 0x%08x, после 5 – 0x%08x (ожидается 0x%08x)\n", afterThree, settled, expected);
+        CHECK(afterThree == 0 && settled == expected);
+
+        chain.inputs165[1] |= 0x80; // Дребезг клавиши 15 при отпускании: короче 4 обновлений не проходит
+        pressedKeys(ms++), pressedKeys(ms++);
+        chain.inputs165[1] &= ~0x80;
+        CHECK(pressedKeys(ms++) == expected);
+        for (uint8_t i = 0; i < BYTES; ++i)
+            chain.inputs165[i] = 0xFF;
+        for (int i = 0; i < 5; ++i)
+            pressedKeys(ms++);
+        CHECK(pressedKeys(ms++) == 0);
+        uint32_t shortPresses = 0;
+        for (uint8_t k = 0; k < Panel::KEY_COUNT; ++k)
+            shortPresses |= (uint32_t)panel.key(k).isShortPress() << k;
+        CHECK(shortPresses == expected);
+    }
+    printf("Передач: %u\n", chain.transfers);
+    return hostTestResult();
+}
@@ -0,0 +1,60 @@
+/**
+ * @file test_static_button.cpp
+ * @brief Сравнение обработчиков кнопки с параметрами при выполнении (ButtonHandler) и при компиляции
+ * (StaticButtonHandler): одинаковые события на одном сигнале, настройка пина, размер состояния и время обновления.
+ *
+ * Время обновления измеряется на хосте; заглушка pinMode() пустая, поэтому для ButtonHandler не учитывается
+ * повторная настройка пина ядром stm32duino при каждом чтении, и разница на устройстве больше.
+ */
+
+#include "HostTest.h"
+#include "ButtonHandler.h"
+
+static const uint32_t DEBOUNCE_US = 50000, LONG_PRESS_US = 500000, TAP_WINDOW_US = 300000;
+typedef StaticButtonHandler<GPIOA_BASE, 6, DEBOUNCE_US, LONG_PRESS_US, TAP_WINDOW_US> StaticButton;
+
+int main()
+{
+    ButtonHandler runtime(PA6, DEBOUNCE_US, LONG_PRESS_US, TAP_WINDOW_US);
+    StaticButton fixed;
+
+    GPIOA->CRL = 0x44444444; // Состояние после сброса: все пины – плавающие входы
+    StaticButton::begin();
+    CHECK(GPIOA->CRL == 0x48444444 && GPIOA->BSRR == 1 << 6); // PA6: вход с подтяжкой к питанию
+
+    { // Одинаковые события на случайной последовательности нажатий с дребезгом (опрос 1 кГц)
+        srand(1);
+        uint32_t events = 0, mismatches = 0;
+        for (int press = 0; press < 2000; ++press)
+        {
+            uint32_t releasedMs = 1 + rand() % 600, heldMs = 1 + rand() % 900, bounceMs = rand() % 8;
+            for (uint32_t t = 0; t < releasedMs + heldMs; ++t)
+            {
+                bool released = t < releasedMs;
+                uint32_t sinceEdge = released ? t : t - releasedMs;
+                if (sinceEdge < bounceMs && rand() % 2)
+                    released = !released;
+                GPIOA->IDR = released ? 1 << 6 : 0;
+                hostMicros += 1000;
+                runtime.updateState(hostMicros), fixed.updateState(hostMicros);
+                bool shortA = runtime.isShortPress(), shortB = fixed.isShortPress();
+                bool longA = runtime.isLongPress(), longB = fixed.isLongPress();
+                uint8_t tapsA = runtime.takeTapCount(), tapsB = fixed.takeTapCount();
+                events += shortA + longA + (tapsA != 0);
+                mismatches += shortA != shortB || longA != longB || tapsA != tapsB ||
+                              runtime.pressDurationMs() != fixed.pressDurationMs();
+            }
+        }
+        printf("События: %u, расхождений: %u\n", events, mismatches);
+        CHECK(events > 2000 && mismatches == 0);
+    }
+
+    const uint32_t updates = 5000000;
+    double runtimeNs = hostNanosecondsPerCall(updates, [&](uint32_t i) { GPIOA->IDR = i >> 14 & 1 ? 1 << 6 : 0, runtime.updateState(i * 1000ULL); });
+    double fixedNs = hostNanosecondsPerCall(updates, [&](uint32_t i) { GPIOA->IDR = i >> 14 & 1 ? 1 << 6 : 0, fixed.updateState(i * 1000ULL); });
+    printf("Состояние: ButtonHandler %zu байт, StaticButtonHandler %zu байт (параметры – %zu байт)\n",
+           sizeof runtime, sizeof fixed, sizeof(ButtonConfig));
+    printf("Обновление на хосте: ButtonHandler %.1f нс, StaticButtonHandler %.1f нс\n", runtimeNs, fixedNs);
+    CHECK(sizeof fixed + sizeof(ButtonConfig) == sizeof runtime);
+    return hostTestResult();
+}
@@ -0,0 +1,116 @@
+#!/usr/bin/env python3
+"""Расшифровка журнала транзакций I2C клавиатуры (прошивка с I2C_TRACE, команда 0x53).
+
+Журнал читается напрямую с шины I2C Linux (/dev/i2c-N) или из вывода команды "trace" тестового устройства
+(строки "TRACE <hex>", файл или стандартный ввод):
+
+    i2c_trace.py --bus 1 [--address 0x20]
+    i2c_trace.py monitor.log
+"""
+import argparse
+import fcntl
+import os
+import struct
+import sys
+
+CMD_READ_TRACE = 0x53
+I2C_SLAVE = 0x0703  # ioctl выбора адреса ведомого (linux/i2c-dev.h)
+RECORD = struct.Struct("<HHIHBB8s")  # TraceHeader (count, stored) и I2cTrace::Entry
+
+STATUSES = {
+    0x00: "W queued",
+    0x01: "W select",
+    0x02: "W dropped",
+    0x03: "W empty",
+    0x04: "W bad",
+    0x40: "BOOT",
+    0x80: "R",
+    0x81: "R alert",
+    0x82: "R second",
+}
+
+COMMANDS = {
+    0x40: "WRITE_LED", 0x42: "READ_TIMING", 0x43: "READ_GESTURES", 0x44: "READ_MATRIX", 0x45: "READ_ENCODER",
+    0x46: "READ_SCHEDULER", 0x47: "READ_COROUTINES", 0x48: "READ_DEBOUNCE", 0x49: "LED_PATTERN",
+    0x4A: "LED_PLAYBACK", 0x4B: "WRITE_EXPANDER", 0x4C: "READ_EXPANDER", 0x4D: "READ_EVENTS", 0x4E: "ACK_EVENTS",
+    0x4F: "BROADCAST_LED", 0x50: "SUBSCRIBE", 0x51: "READ_LED", 0x52: "READ_QUEUE", 0x53: "READ_TRACE",
+    0x54: "READ_HEALTH", 0x55: "WRITE_SETTING", 0x56: "READ_SETTING", 0x57: "READ_STORE",
+}
+
+READ_MODES = [  # Порядок ReadMode в main.cpp
+    "BUTTONS", "LED", "TIMING", "GESTURES", "MATRIX", "EXPANDER", "ENCODER", "SCHEDULER", "COROUTINES", "DEBOUNCE",
+    "EVENTS", "QUEUE", "TRACE", "HEALTH", "SETTING", "STORE",
+]
+
+RESET_FLAGS = {0x04: "PIN", 0x08: "POR", 0x10: "SFT", 0x20: "IWDG", 0x40: "WWDG", 0x80: "LPWR"}
+
+
+def read_bus(bus, address):
+    """Читает записи журнала с шины, от старых к новым (номер записи от последней пересчитывается по счётчику)."""
+    fd = os.open(f"/dev/i2c-{bus}", os.O_RDWR)
+    try:
+        fcntl.ioctl(fd, I2C_SLAVE, address)
+
+        def request(back):
+            os.write(fd, bytes([CMD_READ_TRACE, back]))
+            return os.read(fd, RECORD.size)
+
+        count, stored = RECORD.unpack(request(0))[:2]
+        seq, end = (count - stored) & 0xFFFF, count
+        while seq != end:
+            back = (count - 1 - seq) & 0xFFFF
+            if back >= stored:
+                seq = (seq + 1) & 0xFFFF  # Запись вытеснена новыми транзакциями
+                continue
+            raw = request(back)
+            count = RECORD.unpack(raw)[0]
+            if RECORD.unpack(raw)[3] == seq:
+                yield raw
+                seq = (seq + 1) & 0xFFFF
+    finally:
+        os.close(fd)
+
+
+def read_log(stream):
+    """Выбирает ответы журнала из вывода тестового устройства."""
+    for line in stream:
+        parts = line.split()
+        if len(parts) == 2 and parts[0] == "TRACE":
+            yield bytes.fromhex(parts[1])
+
+
+def describe(status, data):
+    if status == 0x40:
+        flags = [name for bit, name in RESET_FLAGS.items() if data and data[0] & bit]
+        return "reset: " + (", ".join(flags) or "-")
+    if status == 0x80:
+        return READ_MODES[data[0]] if data and data[0] < len(READ_MODES) else "?"
+    if status < 0x80 and data:
+        return COMMANDS.get(data[0], "LED endpoint" if not data[0] & 0x40 else "?")
+    return ""
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("log", nargs="?", help="вывод команды trace тестового устройства (по умолчанию stdin)")
+    parser.add_argument("--bus", type=int, help="номер шины Linux /dev/i2c-N")
+    parser.add_argument("--address", type=lambda s: int(s, 0), default=0x20, help="адрес клавиатуры")
+    args = parser.parse_args()
+
+    if args.bus is not None:
+        records = read_bus(args.bus, args.address)
+    else:
+        records = read_log(open(args.log) if args.log else sys.stdin)
+
+    previous = None
+    for raw in records:
+        _, _, time_us, seq, status, length, data = RECORD.unpack(raw)
+        data = data[:min(length, len(data))]
+        delta = "" if previous is None or status == 0x40 else f"+{(time_us - previous) & 0xFFFFFFFF} us"
+        previous = time_us
+        print(f"{seq:5d} {time_us / 1000:12.3f} ms {delta:>14} {STATUSES.get(status, hex(status)):9} "
+              f"len {length:2d} {data.hex(' '):23} {describe(status, data)}")
+
+
+if __name__ == "__main__":
+    main()